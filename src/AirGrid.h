@@ -0,0 +1,241 @@
+#ifndef _AIR_GRID_H_
+#define _AIR_GRID_H_
+
+#include "VelocityGrid.h"
+#include "TaskGraph.h"
+
+#include <cmath>
+#include <vector>
+
+// Air around cloths, simulated with stable fluids on a coarse grid and
+// coupled both ways: cloths sample it as their wind, and the drag they
+// feel is added back to it as momentum, so a sail leaves a wake. Every
+// step adds that momentum, relaxes towards the ambient wind, advects the
+// velocities semi-Lagrangian and projects them divergence free with Jacobi
+// iterations. The faces of the box hold the ambient wind, which flows in
+// and out through them. Steps are taken once per frame, not per substep.
+template <typename T>
+class AirGrid : public VelocityGrid<T> {
+    public:
+        typedef typename VelocityGrid<T>::vec3 vec3;
+
+    private:
+        using VelocityGrid<T>::origin;
+        using VelocityGrid<T>::cellSize;
+        using VelocityGrid<T>::resolution;
+        using VelocityGrid<T>::nodes;
+        using VelocityGrid<T>::velocity;
+        using VelocityGrid<T>::version;
+        using VelocityGrid<T>::index;
+        using VelocityGrid<T>::position;
+        using VelocityGrid<T>::cell;
+        using VelocityGrid<T>::interpolate;
+
+        const VelocityGrid<T>* ambient;     // the wind far away, or base when nullptr
+        vec3 base;
+        T density;
+        T relaxation;       // rate in 1/s at which the air settles back to ambient
+        int iterations;     // of the pressure solve, kept even
+        T dt;               // of the step being taken
+
+        std::vector<T> momentum[3];     // added by cloths since the last step
+        std::vector<T> target[3];       // ambient velocity at each node
+        std::vector<T> advected[3];
+        std::vector<T> divergence;
+        std::vector<T> pressure;
+        std::vector<T> pressureNext;
+
+        bool onBoundary(int i, int j, int k) const {
+            return i == 0 || j == 0 || k == 0 || i == resolution || j == resolution || k == resolution;
+        }
+
+    public:
+        using VelocityGrid<T>::nodeCount;
+
+        // A cube of resolution^3 cells with its lowest corner at origin
+        AirGrid(glm::vec3 origin, T size, int resolution) : VelocityGrid<T>(origin, size, resolution) {
+            ambient = nullptr;
+            base = vec3(0);
+            density = T(1.225);
+            relaxation = T(0.5);
+            iterations = 20;
+            dt = 0;
+
+            int count = nodeCount();
+            for (int c = 0; c < 3; c++) {
+                momentum[c].assign(count, T(0));
+                target[c].assign(count, T(0));
+                advected[c].assign(count, T(0));
+            }
+            divergence.assign(count, T(0));
+            pressure.assign(count, T(0));
+            pressureNext.assign(count, T(0));
+        }
+
+        // The grid is not owned; nullptr uses the wind set by setWind
+        void setAmbient(const VelocityGrid<T>* field) {ambient = field;}
+
+        void setWind(glm::vec3 wind) {base = vec3(wind);}
+
+        void setIterations(int count) {iterations = std::max(2, count + count % 2);}
+
+        // Spread an impulse, in N s, over the nodes around a point. Not
+        // thread safe: cloths sharing a grid add their momentum in turn.
+        void addMomentum(vec3 p, vec3 impulse) {
+            int corners[8];
+            T weights[8];
+            cell(p.x, p.y, p.z, corners, weights);
+            for (int c = 0; c < 8; c++) {
+                for (int k = 0; k < 3; k++) {
+                    momentum[k][corners[c]] += weights[c] * impulse[k];
+                }
+            }
+        }
+
+        // Phase kernels over ranges of z slices of nodes, in the same style
+        // as Cloth. Walking the nodes slice by slice and row by row keeps
+        // the faces of the box out of the inner loops.
+
+        void advance(T frame) {
+            dt = frame;
+            version++;
+        }
+
+        void applyForces(int begin, int end) {
+            T nodeMass = density * cellSize * cellSize * cellSize;
+            T settle = T(1) - std::exp(-relaxation * dt);
+            for (int n = begin * nodes * nodes; n < end * nodes * nodes; n++) {
+                vec3 wind = ambient ? ambient->sample(position(n)) : base;
+                for (int k = 0; k < 3; k++) {
+                    T v = velocity[k][n] + momentum[k][n] / nodeMass;
+                    velocity[k][n] = v + (wind[k] - v) * settle;
+                    target[k][n] = wind[k];
+                    momentum[k][n] = 0;
+                }
+            }
+        }
+
+        // Trace each node back along its velocity and take what is there
+        void advect(int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                for (int j = 0; j < nodes; j++) {
+                    for (int i = 0; i < nodes; i++) {
+                        int n = index(i, j, k);
+                        if (onBoundary(i, j, k)) {
+                            for (int c = 0; c < 3; c++) {
+                                advected[c][n] = target[c][n];
+                            }
+                            continue;
+                        }
+                        vec3 p = origin + cellSize * vec3(i, j, k) - dt * vec3(velocity[0][n], velocity[1][n], velocity[2][n]);
+                        interpolate(velocity, &p.x, &p.y, &p.z, &advected[0][n], &advected[1][n], &advected[2][n], 1);
+                    }
+                }
+            }
+        }
+
+        void computeDivergence(int begin, int end) {
+            T scale = T(1) / (T(2) * cellSize);
+            int dy = nodes, dz = nodes * nodes;
+            for (int k = begin; k < end; k++) {
+                for (int j = 0; j < nodes; j++) {
+                    int row = index(0, j, k);
+                    bool edge = onBoundary(1, j, k);
+                    for (int n = row; n < row + nodes; n++) {
+                        divergence[n] = 0;
+                    }
+                    if (edge) continue;
+                    for (int n = row + 1; n < row + resolution; n++) {
+                        divergence[n] = (advected[0][n + 1] - advected[0][n - 1] + advected[1][n + dy] - advected[1][n - dy] + advected[2][n + dz] - advected[2][n - dz]) * scale;
+                    }
+                }
+            }
+        }
+
+        // One Jacobi iteration of the pressure Poisson equation, which is
+        // zero on the faces of the box
+        void relaxPressure(const std::vector<T>& from, std::vector<T>& to, int begin, int end) {
+            T h2 = cellSize * cellSize;
+            int dy = nodes, dz = nodes * nodes;
+            const T* p = from.data();
+            for (int k = begin; k < end; k++) {
+                for (int j = 0; j < nodes; j++) {
+                    int row = index(0, j, k);
+                    if (onBoundary(1, j, k)) {
+                        std::fill(&to[row], &to[row] + nodes, T(0));
+                        continue;
+                    }
+                    to[row] = 0;
+                    to[row + resolution] = 0;
+                    for (int n = row + 1; n < row + resolution; n++) {
+                        to[n] = (p[n + 1] + p[n - 1] + p[n + dy] + p[n - dy] + p[n + dz] + p[n - dz] - h2 * divergence[n]) / T(6);
+                    }
+                }
+            }
+        }
+
+        void project(int begin, int end) {
+            T scale = T(1) / (T(2) * cellSize);
+            int dy = nodes, dz = nodes * nodes;
+            for (int k = begin; k < end; k++) {
+                for (int j = 0; j < nodes; j++) {
+                    int row = index(0, j, k);
+                    bool edge = onBoundary(1, j, k);
+                    for (int n = row; n < row + nodes; n++) {
+                        bool boundary = edge || n == row || n == row + resolution;
+                        for (int c = 0; c < 3; c++) {
+                            velocity[c][n] = target[c][n];
+                        }
+                        if (boundary) continue;
+                        velocity[0][n] = advected[0][n] - (pressure[n + 1] - pressure[n - 1]) * scale;
+                        velocity[1][n] = advected[1][n] - (pressure[n + dy] - pressure[n - dy]) * scale;
+                        velocity[2][n] = advected[2][n] - (pressure[n + dz] - pressure[n - dz]) * scale;
+                    }
+                }
+            }
+        }
+
+        // Take one step of length frame. The pressure of the last step is
+        // the first guess of this one.
+        void update(T frame) {
+            advance(frame);
+            applyForces(0, nodes);
+            advect(0, nodes);
+            computeDivergence(0, nodes);
+            for (int i = 0; i < iterations; i += 2) {
+                relaxPressure(pressure, pressureNext, 0, nodes);
+                relaxPressure(pressureNext, pressure, 0, nodes);
+            }
+            project(0, nodes);
+        }
+
+        // The same as update, as chunked nodes after node `after`; returns
+        // the node after which the grid may be sampled
+        int schedule(TaskGraph& graph, int after, T frame) {
+            const int grain = 2;
+            TaskGraph::Size slices = [this] {return nodes;};
+
+            int last = graph.add([this, frame] {advance(frame);});
+            graph.precede(after, last);
+
+            auto chain = [&](TaskGraph::Kernel kernel) {
+                int node = graph.add(slices, grain, kernel);
+                graph.precede(last, node);
+                last = node;
+            };
+            chain([this](int b, int e) {applyForces(b, e);});
+            chain([this](int b, int e) {advect(b, e);});
+            chain([this](int b, int e) {computeDivergence(b, e);});
+            for (int i = 0; i < iterations; i += 2) {
+                chain([this](int b, int e) {relaxPressure(pressure, pressureNext, b, e);});
+                chain([this](int b, int e) {relaxPressure(pressureNext, pressure, b, e);});
+            }
+            chain([this](int b, int e) {project(b, e);});
+            return last;
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class AirGrid<float>;
+extern template class AirGrid<double>;
+#endif
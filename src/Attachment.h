@@ -0,0 +1,80 @@
+#ifndef _ATTACHMENT_H_
+#define _ATTACHMENT_H_
+
+#include "utils.h"
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Rigid motion in world space that pinned vertices can follow: keyframes
+// of a translation and a rotation, interpolated linearly and by slerp and
+// held before the first and after the last. A rigid body drives one by
+// adding a key for the end of every frame and dropping the keys it is past.
+template <typename T>
+class AttachmentTrack {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+        typedef glm::mat<4, 4, T, glm::defaultp> mat4;
+        typedef glm::qua<T, glm::defaultp> quat;
+
+    private:
+        struct Key {
+            T time;
+            vec3 translation;
+            quat rotation;
+        };
+        std::vector<Key> keys;      // by time
+
+    public:
+        // The transform, which must be rigid, from the time on. A key at
+        // the same time replaces the one there.
+        void addKey(T time, const mat4& transform) {
+            Key key = {time, vec3(transform[3]), glm::quat_cast(glm::mat<3, 3, T, glm::defaultp>(transform))};
+            auto it = std::lower_bound(keys.begin(), keys.end(), time, [](const Key& k, T t) {return k.time < t;});
+            if (it != keys.end() && it->time == time) {
+                *it = key;
+            } else {
+                keys.insert(it, key);
+            }
+        }
+
+        // Drop the keys no time from the given one on needs
+        void dropBefore(T time) {
+            int keep = 0;
+            while (keep + 1 < (int)keys.size() && keys[keep + 1].time <= time) keep++;
+            keys.erase(keys.begin(), keys.begin() + keep);
+        }
+
+        void clear() {keys.clear();}
+
+        mat4 at(T time) const {
+            if (keys.empty()) return mat4(T(1));
+            if (time <= keys.front().time) return transform(keys.front().translation, keys.front().rotation);
+            if (time >= keys.back().time) return transform(keys.back().translation, keys.back().rotation);
+            auto it = std::upper_bound(keys.begin(), keys.end(), time, [](T t, const Key& k) {return t < k.time;});
+            const Key& a = *(it - 1);
+            const Key& b = *it;
+            T s = (time - a.time) / (b.time - a.time);
+            return transform(glm::mix(a.translation, b.translation, s), glm::slerp(a.rotation, b.rotation, s));
+        }
+
+        static mat4 transform(const vec3& translation, const quat& rotation) {
+            mat4 m = glm::mat4_cast(rotation);
+            m[3] = glm::vec<4, T, glm::defaultp>(translation, T(1));
+            return m;
+        }
+};
+
+// A vertex held at an anchor, in world space or in the frame of a track
+template <typename T>
+struct Attachment {
+    int vertex;
+    int track;      // -1 for none
+    glm::vec<3, T, glm::defaultp> anchor;
+};
+
+// Instantiated once in Physics.cpp
+extern template class AttachmentTrack<float>;
+extern template class AttachmentTrack<double>;
+#endif
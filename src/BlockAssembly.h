@@ -0,0 +1,108 @@
+#ifndef _BLOCK_ASSEMBLY_H_
+#define _BLOCK_ASSEMBLY_H_
+
+#include "BlockMatrix.h"
+
+#include <utility>
+#include <vector>
+
+// Cached assembly of the matrix of an implicit step. Every element, such
+// as a spring or a face, is a source of derivatives, and the blocks each
+// source adds to are found once per pattern and kept as a map sorted by
+// row. A step then fills the derivatives of the sources side by side and
+// gathers them row by row, also side by side since each row is written by
+// one chunk only, without looking up a block or allocating. Contributions
+// keep the order they were added in, so the sums come out the same
+// whatever the threads.
+template <typename T>
+class BlockAssembly {
+    public:
+        typedef typename BlockMatrix<T>::vec3 vec3;
+        typedef typename BlockMatrix<T>::mat3 mat3;
+
+    private:
+        struct Contribution {
+            int slot;       // block of the matrix
+            int source;     // ~source when it adds the opposite
+        };
+
+        const BlockMatrix<T>* matrix;           // being mapped
+        std::vector<std::pair<int, Contribution> > added;   // with their rows
+        std::vector<int> starts;                // of each row in contributions
+        std::vector<Contribution> contributions;
+        std::vector<mat3> stiffness;            // derivatives by the position
+        std::vector<mat3> damping;              // and by the velocity
+        unsigned long long version;             // of the pattern the slots are in
+
+    public:
+        BlockAssembly() : matrix(nullptr), version(~0ull) {}
+
+        // Start a new map into the pattern of A for the given number of
+        // sources
+        void clear(const BlockMatrix<T>& A, int sources) {
+            matrix = &A;
+            added.clear();
+            stiffness.assign(sources, mat3(T(0)));
+            damping.assign(sources, mat3(T(0)));
+        }
+
+        // Source adds its derivatives of the force on row by column, or
+        // their opposite
+        void add(int row, int column, int source, bool opposite = false) {
+            Contribution c = {matrix->find(row, column), opposite ? ~source : source};
+            added.push_back(std::make_pair(row, c));
+        }
+
+        // Sort the contributions by row, keeping their order within a row
+        void finish() {
+            int n = matrix->rows();
+            starts.assign(n + 1, 0);
+            for (auto& a : added) starts[a.first + 1]++;
+            for (int i = 0; i < n; i++) starts[i + 1] += starts[i];
+            contributions.resize(added.size());
+            std::vector<int> fill(starts.begin(), starts.end() - 1);
+            for (auto& a : added) contributions[fill[a.first]++] = a.second;
+            added.clear();
+            added.shrink_to_fit();
+            version = matrix->version;
+        }
+
+        // Whether the map was built for the current pattern of A
+        bool current(const BlockMatrix<T>& A) const {return version == A.version;}
+
+        mat3* getStiffness() {return stiffness.data();}
+        mat3* getDamping() {return damping.data();}
+
+        // Fill A and b for a step of length h: every row starts from
+        // init(i), which sets its diagonal block and b[i], and the
+        // unconstrained ones take h^2 dx v[column] on b from all their
+        // couplings, so pins moving along a track pull on their neighbours,
+        // and -h dv - h^2 dx from those to unconstrained columns
+        template <typename F, typename V>
+        void assemble(ThreadPool* pool, T h, BlockMatrix<T>& A, std::vector<vec3>& b,
+                      const std::vector<char>& constrained, const V& velocity, const F& init) const {
+            BlockMatrix<T>::forRange(pool, A.rows(), 512, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    for (int k = A.starts[i]; k < A.starts[i + 1]; k++) {
+                        A.blocks[k] = mat3(T(0));
+                    }
+                    init(i);
+                    if (constrained[i]) continue;
+                    for (int k = starts[i]; k < starts[i + 1]; k++) {
+                        const Contribution& c = contributions[k];
+                        int j = A.columns[c.slot];
+                        mat3 dx = (c.source < 0) ? -stiffness[~c.source] : stiffness[c.source];
+                        b[i] += h * h * (dx * velocity(j));
+                        if (constrained[j]) continue;
+                        mat3 dv = (c.source < 0) ? -damping[~c.source] : damping[c.source];
+                        A.blocks[c.slot] -= h * dv + h * h * dx;
+                    }
+                }
+            });
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class BlockAssembly<float>;
+extern template class BlockAssembly<double>;
+#endif
@@ -0,0 +1,93 @@
+#ifndef _BLOCK_MATRIX_H_
+#define _BLOCK_MATRIX_H_
+
+#include "utils.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Sparse matrix of 3x3 blocks stored by rows (BSR), one block row per
+// vertex. The pattern is set once from the pairs of vertices that interact
+// and kept while the values are refilled, so solvers and preconditioners
+// built on top only redo their own setup when the version changes.
+template <typename T>
+class BlockMatrix {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+        typedef glm::mat<3, 3, T, glm::defaultp> mat3;
+
+        std::vector<int> starts;        // first block of each row, and one past the last
+        std::vector<int> columns;       // sorted within each row
+        std::vector<int> diagonals;     // block of each row on the diagonal
+        std::vector<mat3> blocks;
+        unsigned long long version;     // bumped by every new pattern
+
+        BlockMatrix() : version(0) {
+            starts.assign(1, 0);
+        }
+
+        int rows() const {return starts.size() - 1;}
+
+        // Calls f(chunkBegin, chunkEnd) over [0, count) on the pool, or
+        // whole on the caller without one
+        template <typename F>
+        static void forRange(ThreadPool* pool, int count, int grain, const F& f) {
+            if (pool) {
+                pool->parallelFor(0, count, grain, f);
+            } else if (count > 0) {
+                f(0, count);
+            }
+        }
+
+        // Take the pattern of the (row, column) pairs, which may repeat,
+        // plus the whole diagonal of a square matrix. Every block is zeroed.
+        void setPattern(int rowCount, std::vector<std::pair<int, int> >& pairs, bool square = true) {
+            for (int i = 0; square && i < rowCount; i++) {
+                pairs.push_back(std::make_pair(i, i));
+            }
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+            starts.assign(rowCount + 1, 0);
+            columns.resize(pairs.size());
+            diagonals.resize(rowCount);
+            for (size_t k = 0; k < pairs.size(); k++) {
+                starts[pairs[k].first + 1]++;
+                columns[k] = pairs[k].second;
+                if (pairs[k].first == pairs[k].second) diagonals[pairs[k].first] = k;
+            }
+            for (int i = 0; i < rowCount; i++) {
+                starts[i + 1] += starts[i];
+            }
+            blocks.assign(pairs.size(), mat3(T(0)));
+            version++;
+        }
+
+        // Block of (row, column), or -1 outside the pattern
+        int find(int row, int column) const {
+            auto first = columns.begin() + starts[row];
+            auto last = columns.begin() + starts[row + 1];
+            auto it = std::lower_bound(first, last, column);
+            return (it != last && *it == column) ? it - columns.begin() : -1;
+        }
+
+        void zero() {std::fill(blocks.begin(), blocks.end(), mat3(T(0)));}
+
+        // y = A x over the rows [begin, end)
+        void multiply(const std::vector<vec3>& x, std::vector<vec3>& y, int begin, int end) const {
+            for (int i = begin; i < end; i++) {
+                vec3 sum(0);
+                for (int k = starts[i]; k < starts[i + 1]; k++) {
+                    sum += blocks[k] * x[columns[k]];
+                }
+                y[i] = sum;
+            }
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class BlockMatrix<float>;
+extern template class BlockMatrix<double>;
+#endif
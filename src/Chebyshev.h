@@ -0,0 +1,88 @@
+#ifndef _CHEBYSHEV_H_
+#define _CHEBYSHEV_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Chebyshev semi-iterative acceleration (Wang 2015) of any stationary
+// iteration x <- J(x), such as a Jacobi solve or the iterations of
+// projective dynamics. The k-th plain iterate y is replaced by
+// omega_k (y - x_(k-1)) + x_(k-1), with weights from the spectral radius rho
+// of the iteration. Rho is estimated on the fly: the first iterations of
+// every solve run plain, and the rate at which their changes shrink, which
+// only nears rho from below, is taken a little closer to 1. The largest
+// estimate seen recently is kept, since too low a rho makes the accelerated
+// iteration diverge; a change that grows well past the one acceleration
+// started from raises rho and starts the weights over.
+template <typename T>
+class Chebyshev {
+    private:
+        bool enabled;
+        int delay;          // plain iterations that measure rho in each solve
+        T rho;
+        T decay;            // per solve, lets rho come down when the system softens
+        T margin;           // of 1 - rho kept by an estimate
+        int iteration;
+        T omega;
+        T lastChange;
+        T startChange;      // of the iteration acceleration started after
+
+    public:
+        Chebyshev(int delay = 6) : enabled(true), delay(std::max(2, delay)), rho(0), decay(T(0.99)), margin(T(0.8)), iteration(0), omega(1), lastChange(0), startChange(0) {}
+
+        void setEnabled(bool e) {enabled = e;}
+        bool getEnabled() const {return enabled;}
+        T getSpectralRadius() const {return rho;}
+
+        // Before the first iteration of a solve
+        void start() {
+            iteration = 0;
+            omega = 1;
+            lastChange = 0;
+            rho *= decay;
+        }
+
+        // Weight of the iteration about to be taken
+        T weight() const {return omega;}
+
+        // After every iteration, with the squared norm of its change
+        void next(T change) {
+            iteration++;
+            if (!enabled) return;
+            if (iteration <= delay) {
+                if (iteration > 1 && lastChange > 0) {
+                    T rate = std::min(T(1), std::sqrt(change / lastChange));
+                    rho = std::max(rho, std::min(T(0.999), T(1) - margin * (T(1) - rate)));
+                }
+                lastChange = change;
+                startChange = change;
+                if (iteration == delay) omega = T(2) / (T(2) - rho * rho);
+                return;
+            }
+            if (change > T(4) * startChange) {
+                // diverging: the estimate was too low
+                rho = std::min(T(0.999), T(1) - margin * (T(1) - rho));
+                iteration = delay;
+                startChange = change;
+                omega = T(2) / (T(2) - rho * rho);
+                return;
+            }
+            omega = T(4) / (T(4) - rho * rho * omega);
+        }
+
+        // x = omega (x - older) + older over [begin, end), turning the
+        // plain iterate in x into the accelerated one
+        template <typename V>
+        void blend(std::vector<V>& x, const std::vector<V>& older, int begin, int end) const {
+            if (omega == 1) return;
+            for (int i = begin; i < end; i++) {
+                x[i] = omega * (x[i] - older[i]) + older[i];
+            }
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class Chebyshev<float>;
+extern template class Chebyshev<double>;
+#endif
@@ -0,0 +1,92 @@
+#ifndef _CHOLESKY_H_
+#define _CHOLESKY_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Sparse Cholesky factorization A = L L^T of a symmetric definite matrix,
+// stored by its envelope: row i of L keeps every entry from its first
+// nonzero column to the diagonal, which is where all the fill of the
+// factorization lands. Cloths number their vertices row by row, so the
+// envelope of a row reaches back about one grid row, and factoring costs
+// n w^2 for n vertices and w columns while each solve costs 2 n w.
+template <typename T>
+class Cholesky {
+    private:
+        std::vector<int> first;     // first column of each row
+        std::vector<int> offsets;   // of the diagonal of each row
+        std::vector<T> factor;
+
+    public:
+        int rows() const {return first.size();}
+
+        // Factor the lower triangle of a matrix stored by rows, whose
+        // columns are sorted. Returns false if it is not definite.
+        bool compute(const std::vector<int>& starts, const std::vector<int>& columns, const std::vector<T>& values) {
+            int n = starts.size() - 1;
+            first.resize(n);
+            offsets.resize(n);
+            int size = 0;
+            for (int i = 0; i < n; i++) {
+                first[i] = std::min(i, columns[starts[i]]);
+                size += i - first[i];
+                offsets[i] = size;
+                size++;
+            }
+            factor.assign(size, T(0));
+            for (int i = 0; i < n; i++) {
+                T* row = &factor[offsets[i] - (i - first[i])];
+                for (int k = starts[i]; k < starts[i + 1] && columns[k] <= i; k++) {
+                    row[columns[k] - first[i]] = values[k];
+                }
+            }
+
+            for (int i = 0; i < n; i++) {
+                T* row = &factor[offsets[i] - (i - first[i])];
+                for (int j = first[i]; j < i; j++) {
+                    const T* other = &factor[offsets[j] - (j - first[j])];
+                    int from = std::max(first[i], first[j]);
+                    T s = row[j - first[i]];
+                    for (int k = from; k < j; k++) {
+                        s -= row[k - first[i]] * other[k - first[j]];
+                    }
+                    row[j - first[i]] = s / factor[offsets[j]];
+                }
+                T d = row[i - first[i]];
+                for (int k = first[i]; k < i; k++) {
+                    d -= row[k - first[i]] * row[k - first[i]];
+                }
+                if (!(d > 0)) return false;
+                row[i - first[i]] = std::sqrt(d);
+            }
+            return true;
+        }
+
+        // Solve A x = b in place, with b and x strided in memory, so the
+        // components of an array of vectors can be solved one at a time
+        void solve(T* b, int stride = 1) const {
+            int n = rows();
+            for (int i = 0; i < n; i++) {
+                const T* row = &factor[offsets[i] - (i - first[i])];
+                T s = b[i * stride];
+                for (int k = first[i]; k < i; k++) {
+                    s -= row[k - first[i]] * b[k * stride];
+                }
+                b[i * stride] = s / factor[offsets[i]];
+            }
+            for (int i = n - 1; i >= 0; i--) {
+                const T* row = &factor[offsets[i] - (i - first[i])];
+                T x = b[i * stride] / factor[offsets[i]];
+                b[i * stride] = x;
+                for (int k = first[i]; k < i; k++) {
+                    b[k * stride] -= row[k - first[i]] * x;
+                }
+            }
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class Cholesky<float>;
+extern template class Cholesky<double>;
+#endif
@@ -5,71 +5,1620 @@
 #include "Vertex.h"
 #include "Triangle.h"
 #include "SpringDamper.h"
+#include "Collider.h"
+#include "Attachment.h"
+#include "WindField.h"
+#include "AirGrid.h"
+#include "TaskGraph.h"
+#include "ImplicitSolver.h"
+#include "BlockAssembly.h"
+#include "ProjectiveSolver.h"
 
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+
+// Render data of one cloth, handed from the simulation to the GL thread
+struct ClothFrame {
+    typedef std::pair<size_t, size_t> Range;    // of indices, [first, second)
+    static const int history = 64;              // topology versions kept in edits
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> indices;
+    unsigned long long topology;    // version of the indices held
+    unsigned long long motion;      // and of the positions and normals
+    std::vector<Range> edits;       // that made version v, at v % history
+    int solverFailures;             // projective systems found not definite
+
+    ClothFrame() : topology(~0ull), motion(~0ull), edits(history, Range(0, 0)), solverFailures(0) {}
+
+    // The indices edited from version from to version to, out of count,
+    // merged over the versions between; all of them when from is unknown
+    // or older than the edits kept
+    static Range edited(const std::vector<Range>& edits, unsigned long long from, unsigned long long to, size_t count) {
+        if (from > to || to - from >= (unsigned long long)history) return Range(0, count);
+        Range merged(count, 0);
+        for (unsigned long long v = from + 1; v <= to; v++) {
+            const Range& r = edits[v % history];
+            merged.first = std::min(merged.first, r.first);
+            merged.second = std::max(merged.second, r.second);
+        }
+        merged.second = std::min(merged.second, count);
+        return merged;
+    }
+};
+
+template <typename T>
 class Cloth {
+    public:
+        typedef typename Vertices<T>::vec3 vec3;
+
+        enum Integrator {EXPLICIT, IMPLICIT, PROJECTIVE, VERLET};
+
     private:
         int width;
         int height;
-        glm::vec3 pointWind;
+        vec3 pointWind;
         glm::vec3 translation;
-        std::vector<int> indexFixed;
+
+        // Pinned vertices, as a compact list. Every vertex integrates alike
+        // and the pins are put back on their targets afterwards, moving
+        // with the velocity of their targets. Static anchors are in model
+        // space and the anchors of vertices following a track in its frame.
+        std::vector<Attachment<T> > attachments;
+        std::vector<AttachmentTrack<T> > tracks;
+        bool released;      // by toggleFree, which keeps the list
+        T clock;            // time simulated
 
         GLuint VAO;
         GLuint VBO_positions, VBO_normals, EBO;
+        GLsizei indexCount;
+        unsigned long long topology;            // bumped by every tear
+        unsigned long long uploadedTopology;
+        unsigned long long motion;              // bumped by every substep that moves a vertex
+        unsigned long long uploadedMotion;
 
         glm::mat4 model;
         glm::vec3 color;
+        vec3 gravity;
+        // Linear drag, in 1/s, of the air around each vertex: the wind of
+        // its faces. The face drag grows with the square of the speed and
+        // all but vanishes as a cloth comes to rest, so a sleeping cloth
+        // needs it to settle; otherwise it is 0.
+        T airDamping;
 
-        std::vector<Vertex*> vertices;
-        std::vector<Triangle*> triangles;
-        std::vector<SpringDamper*> springDampers;
+        Vertices<T> vertices;
+        std::vector<Triangle<T>*> triangles;
+        std::vector<SpringDamper<T>*> springDampers;
 
         std::vector<glm::vec3> positions;
         std::vector<glm::vec3> normals;
         std::vector<unsigned int> indices;
 
-        void updateNormal() {
-            for (auto v : vertices) {
-                v->normal = glm::vec3(0);
+        // Tearing: springs stretched past (1 + tearStrain) times their rest
+        // length break, and vertices whose triangle fan is cut apart split.
+        // Adjacency is kept up to date incrementally so a tear never
+        // rebuilds the spring arrays, and the edited index range is sent to
+        // the EBO in one batch on the next upload. Split vertices are
+        // appended, so their springs fall into the overflow band; once it
+        // holds more than 1/32 of the springs, all is renumbered.
+        T tearStrain;
+        std::vector<unsigned int> springIndices;
+        std::vector<std::vector<int> > vertexTriangles;
+        std::vector<std::vector<int> > vertexSprings;
+        std::unordered_set<unsigned long long> tornEdges;
+        std::vector<int> tornSprings;
+        std::mutex tearLock;
+        size_t dirtyBegin, dirtyEnd;        // indices edited since the last version
+        std::vector<ClothFrame::Range> edits;   // by the last versions, as in ClothFrame
+        unsigned long long renumberings;    // since construction
+
+        // Callers name vertices by id: the index a vertex had when it was
+        // made, which renumbering leaves alone
+        std::vector<int> vertexIds;     // per index
+        std::vector<int> vertexIndices; // per id
+
+        // Springs and triangles are grouped into bands by their lowest
+        // vertex index. Springs of one band only reach into the next band,
+        // so the strain limiting pass can move the ends of all even bands,
+        // then all odd bands, at the same time while each band keeps the
+        // construction order and its cache locality. Springs spanning more
+        // than a band, such as those on vertices appended by a tear, go into
+        // a last overflow band. The forces of springs and triangles are
+        // stored per element and gathered by each vertex, and the force pass
+        // takes the bands as tiles: the elements of a band, then its
+        // vertices, which only have elements in that band, the band before
+        // and the overflow band. A tile stays in cache from the first read of
+        // its vertices to the gather.
+        int bandSize;
+        std::vector<std::vector<int> > springBands;
+        std::vector<std::vector<int> > triangleBands;
+        std::vector<vec3> springForces;     // on the first end of each spring
+        std::vector<vec3> faceNormals;
+        std::vector<vec3> faceForces;
+
+        // Stencils. Until the first tear the springs are the families of the
+        // grid the cloth was built on, each a fixed step in rows and columns
+        // from its lower end, and a cloth that can not tear computes them
+        // with a kernel per family that walks the vertices in order and
+        // finds the other end by the step, without the spring arrays. Their
+        // forces are kept per family at the lower end, 0 where there is no
+        // spring, so each vertex gathers them by the same steps.
+        bool regular;
+        int stencilCount;       // families, 8 with the long springs
+        int stencilSteps[8];    // in vertex indices
+        T stencilRest[8];
+        T springStiffness, springDamping;
+        std::vector<vec3> stencilForces;    // by family, then lower end
+
+        // Springs are held between these multiples of their rest length
+        T strainLower, strainUpper;
+
+        // When set, replaces pointWind with the field sampled at each face.
+        // The samples are kept for the substeps until the field is rebuilt.
+        const VelocityGrid<T>* windField;
+        std::vector<vec3> faceWinds;
+        unsigned long long windVersion;     // field version of faceWinds
+
+        // When coupled to an air grid, which is then also the wind field,
+        // the drag of every face is summed up as an impulse on the air
+        // until injectAir hands it over
+        AirGrid<T>* airGrid;
+        std::vector<vec3> faceImpulses;
+        T timestep;
+
+        // Adaptive substeps. The change of every vertex's acceleration over
+        // a substep, times dt^2 / 2, estimates the error of the integrator,
+        // and the next step is sized to keep it near the tolerance while no
+        // vertex moves more than a fraction of the grid spacing. A substep
+        // whose error is far past the tolerance is rolled back to the state
+        // saved by integrate and taken again as two halves, and steps stay
+        // below it until a run of accepted steps lifts the limit again.
+        bool adaptive;
+        T tolerance;        // of the position error of one substep, in m
+        T minStep, maxStep;
+        T proposedStep;     // for the substeps of the next frame
+        T stepLimit;
+        T spacing;
+        T stepChange;       // largest change of acceleration in this substep
+        T stepSpeed;        // and largest speed
+        unsigned long long rejections;
+        std::mutex errorLock;
+        std::vector<vec3> savedPositions;
+        std::vector<vec3> savedVelocities;
+        std::vector<vec3> savedForces;
+        std::vector<vec3> savedPrevious;
+
+        // Sleeping. A band of vertices whose kinetic energy per unit mass
+        // stays below sleepEnergy for sleepSteps substeps in a row stops,
+        // and every pass skips it, keeping the forces stored for its springs
+        // and faces, until a neighbouring band moves, the wind on its faces
+        // changes by more than wakeWind or the cloth is moved or edited. A
+        // cloth with every band asleep drops out of the task graph.
+        T sleepEnergy;      // in J/kg, 0 never sleeps
+        int sleepSteps;
+        T wakeWind;
+        std::vector<char> sleeping;     // per band of vertices
+        std::vector<int> stillSteps;
+        std::vector<T> bandEnergy;
+        std::vector<int> wakeRequests;  // bands, from the face pass
+        std::mutex wakeLock;
+
+        // Isometric bending (Bergou et al. 2006). Every interior edge and
+        // its two opposite corners add a 4x4 block, made of cotangents of
+        // the rest shape, to a matrix Q, and the bending force is
+        // -Q (stiffness x + damping v). Q is stored by rows, so each vertex
+        // gathers its own force in the vertex pass, and only rebuilt when
+        // tears change the edges.
+        T bendingStiffness;
+        T bendingDamping;
+        std::vector<vec3> restPositions;
+        std::vector<int> bendingStarts;
+        std::vector<int> bendingColumns;
+        std::vector<T> bendingValues;
+
+        // Membrane model: in place of the springs, every triangle is a
+        // finite element of an orthotropic material, computed in the face
+        // pass with the wind. The forces on the three corners of each face
+        // are stored and gathered by the vertices like the wind forces.
+        // Springs still find the tears, without adding their forces.
+        bool membrane;
+        Membrane<T> material;
+        std::vector<vec3> cornerForces;
+
+        // Implicit integration (Baraff and Witkin 1998). Before a substep,
+        // one Newton step of backward Euler linearizes the springs, the
+        // bending and the membrane around the current state and solves
+        // (M - h dF/dv - h^2 dF/dx) dv = h (F + h dF/dx v) for the change of
+        // the velocities, with conjugate gradients preconditioned by
+        // multigrid V-cycles over the grid the cloth was built on. The wind
+        // stays explicit, and fixed and sleeping vertices keep dv = 0.
+        Integrator integrator;
+        T implicitStep;     // longest substep when the step is not adaptive
+        ImplicitSolver<T> solver;
+        BlockAssembly<T> assembly;      // springs or faces, then bending entries
+        bool assemblyMembrane;          // whether faces are its sources
+        ThreadPool* pool;   // runs the solvers' kernels, or nullptr
+        std::vector<int> gridCells;     // grid vertex each vertex was built as, or split from
+        unsigned long long solverTopology;
+
+        // Projective dynamics: the springs and the bending are solved for
+        // the positions, with the forces of the face pass, gravity and the
+        // wind, as the only explicit ones. The membrane model falls back
+        // to the springs.
+        ProjectiveSolver<T> projective;
+        std::vector<vec3> startPositions;   // of the substep
+        std::vector<vec3> targets;          // where the vertices would coast to
+        std::vector<T> vertexMasses;
+        std::vector<char> projectiveConstrained;   // pinned
+        std::vector<char> projectiveHeld;          // asleep
+        unsigned long long projectiveTopology;
+        bool projectiveSolved;      // false if the system was not definite
+
+        // Stormer-Verlet: the state is the last two positions, and the
+        // velocity is their difference, damped by a fraction each substep.
+        // When the step changes from h' to h the difference is scaled by
+        // h / h' and the acceleration taken over h (h + h') / 2, which is
+        // second order for variable steps. The velocities of the vertices
+        // are neither kept nor read; whatever needs one takes the
+        // difference over the step from velocityOf(), and setIntegrator
+        // converts between the two states.
+        std::vector<vec3> previousPositions;
+        T lastStep;         // that led to the positions
+        T verletDamping;
+        T verletScale, verletKick;      // of the substep, from prepareVerlet
+        T savedStep;        // lastStep before the substep, for retryStep
+
+        int bandOf(const unsigned int* element, int arity) {
+            unsigned int lo = element[0];
+            unsigned int hi = element[0];
+            for (int k = 1; k < arity; k++) {
+                lo = std::min(lo, element[k]);
+                hi = std::max(hi, element[k]);
+            }
+            return (hi - lo < (unsigned int)bandSize) ? lo / bandSize : -1;
+        }
+
+        void buildBands(const std::vector<unsigned int>& elementIndices, int arity, std::vector<std::vector<int> >& bands) {
+            int count = (vertices.size() + bandSize - 1) / bandSize;
+            bands.resize(count + 1);
+            for (auto& b : bands) {
+                b.clear();
             }
+            for (size_t e = 0; e < elementIndices.size() / arity; e++) {
+                int b = bandOf(&elementIndices[arity * e], arity);
+                bands[(b < 0) ? count : b].push_back(e);
+            }
+        }
 
-            for (auto t : triangles) {
-                t->updateNormal();
+        // Put values, arity per item, in the given order of the old items
+        template <typename V>
+        static void permute(std::vector<V>& values, const std::vector<int>& order, int arity = 1) {
+            std::vector<V> sorted;
+            sorted.reserve(values.size());
+            for (auto e : order) {
+                for (int k = 0; k < arity; k++) {
+                    sorted.push_back(values[arity * e + k]);
+                }
             }
+            values.swap(sorted);
+        }
 
-            for (auto v : vertices) {
-                v->normal = glm::normalize(v->normal);
+        // Renumber elements band by band, so each band is a contiguous run,
+        // and return the old number of each
+        template <typename E>
+        std::vector<int> sortByBand(std::vector<E*>& elements, std::vector<unsigned int>& elementIndices, int arity) {
+            std::vector<std::vector<int> > bands;
+            buildBands(elementIndices, arity, bands);
+
+            std::vector<int> order;
+            for (auto& band : bands) {
+                order.insert(order.end(), band.begin(), band.end());
             }
+            permute(elements, order);
+            permute(elementIndices, order, arity);
+            return order;
         }
 
-        void updateAcceleration() {
-            for (auto v : vertices) {
-                v->resetAcceleration();
-                v->addAcceleration(glm::inverse(model) * glm::vec4(0, -9.8, 0, 0));
+        // Bands of one parity, not counting the overflow band
+        static int bandsOfParity(const std::vector<std::vector<int> >& bands, int parity) {
+            return (bands.size() - parity) / 2;
+        }
+
+        int vertexBands() {return (vertices.size() + bandSize - 1) / bandSize;}
+
+        bool asleep(unsigned int v) {return sleeping[v / bandSize];}
+
+        // Velocity of vertex v, kept or, with Verlet steps, derived
+        vec3 velocityOf(unsigned int v) {
+            if (integrator != VERLET) return vertices.velocity[v];
+            return (vertices.position[v] - previousPositions[v]) / lastStep;
+        }
+
+        // Calls f(b, e) for the runs [b, e) of [begin, end) in bands that
+        // are awake, a band at a time
+        template <typename F>
+        void forAwakeRuns(int begin, int end, const F& f) {
+            for (int i = begin; i < end;) {
+                int stop = std::min(end, (i / bandSize + 1) * bandSize);
+                if (!sleeping[i / bandSize]) f(i, stop);
+                i = stop;
             }
-            for (auto sd : springDampers) {
-                sd->updateAcceleration();
+        }
+
+        // Calls f(i) for the vertices of [begin, end) in bands that are awake
+        template <typename F>
+        void forAwake(int begin, int end, const F& f) {
+            forAwakeRuns(begin, end, [&](int b, int e) {
+                for (int i = b; i < e; i++) f(i);
+            });
+        }
+
+        // Whether any corner of the count faces listed is awake
+        bool facesAwake(const int* faces, int count) {
+            for (int l = 0; l < count; l++) {
+                for (int k = 0; k < 3; k++) {
+                    if (!asleep(indices[3 * faces[l] + k])) return true;
+                }
+            }
+            return false;
+        }
+
+        void wakeAll() {
+            std::fill(sleeping.begin(), sleeping.end(), 0);
+            std::fill(stillSteps.begin(), stillSteps.end(), 0);
+        }
+
+        void resizeSleep() {
+            sleeping.resize(vertexBands(), 0);
+            stillSteps.resize(vertexBands(), 0);
+            bandEnergy.resize(vertexBands(), T(0));
+        }
+
+        // Serial, after a substep is accepted: wake the bands asked for and
+        // those next to moving bands, then put the bands that stayed still
+        // long enough to sleep
+        void updateSleep() {
+            if (sleepEnergy <= 0) return;
+            for (auto b : wakeRequests) {
+                sleeping[b] = 0;
+                stillSteps[b] = 0;
+                windVersion = ~0ull;
+            }
+            wakeRequests.clear();
+
+            int count = vertexBands();
+            for (int b = 0; b < count; b++) {
+                if (sleeping[b]) continue;
+                T energy = 0;
+                T mass = 0;
+                int end = std::min((int)vertices.size(), (b + 1) * bandSize);
+                for (int i = b * bandSize; i < end; i++) {
+                    if (vertices.isFixed(i)) continue;
+                    vec3 v = velocityOf(i);
+                    energy += vertices.mass[i] * glm::dot(v, v) / T(2);
+                    mass += vertices.mass[i];
+                }
+                bandEnergy[b] = (mass > 0) ? energy / mass : T(0);
             }
 
-            for (auto t : triangles) {
-                t->addWind(pointWind);
+            // springs of the overflow band may tie any two bands together
+            T wake = T(4) * sleepEnergy;
+            auto moving = [&](int b) {return !sleeping[b] && bandEnergy[b] > wake;};
+            std::vector<int> woken;
+            for (int b = 0; b < count; b++) {
+                if (sleeping[b] && ((b > 0 && moving(b - 1)) || (b + 1 < count && moving(b + 1)))) woken.push_back(b);
+            }
+            for (auto s : springBands.back()) {
+                int b1 = springIndices[2 * s] / bandSize, b2 = springIndices[2 * s + 1] / bandSize;
+                if (sleeping[b1] && moving(b2)) woken.push_back(b1);
+                if (sleeping[b2] && moving(b1)) woken.push_back(b2);
+            }
+            for (auto b : woken) {
+                sleeping[b] = 0;
+                stillSteps[b] = 0;
+                bandEnergy[b] = wake;
+            }
+            if (!woken.empty()) {
+                // the faces of the woken bands still hold an old wind
+                windVersion = ~0ull;
+            }
+
+            for (int b = 0; b < count; b++) {
+                if (sleeping[b]) continue;
+                stillSteps[b] = (bandEnergy[b] < sleepEnergy) ? stillSteps[b] + 1 : 0;
+                if (stillSteps[b] < sleepSteps) continue;
+                sleeping[b] = 1;
+                int end = std::min((int)vertices.size(), (b + 1) * bandSize);
+                for (int i = b * bandSize; i < end; i++) {
+                    if (integrator == VERLET) {
+                        previousPositions[i] = vertices.position[i];
+                    } else if (!vertices.isFixed(i)) {
+                        vertices.velocity[i] = vec3(0);
+                    }
+                }
+            }
+        }
+
+        static unsigned long long edgeKey(unsigned int a, unsigned int b) {
+            if (a > b) std::swap(a, b);
+            return ((unsigned long long)a << 32) | b;
+        }
+
+        void addSpringDamper(int t1, int t2, T rl) {
+            springDampers.push_back(new SpringDamper<T>(rl));
+            springIndices.push_back(t1);
+            springIndices.push_back(t2);
+        }
+
+        static T cotangent(vec3 a, vec3 b) {
+            return glm::dot(a, b) / glm::length(glm::cross(a, b));
+        }
+
+        void buildBending() {
+            struct Entry {
+                int row, column;
+                T value;
+                bool operator<(const Entry& e) const {return (row != e.row) ? row < e.row : column < e.column;}
+            };
+            std::vector<Entry> entries;
+
+            for (size_t t = 0; t < triangles.size(); t++) {
+                for (int k = 0; k < 3; k++) {
+                    unsigned int x0 = indices[3 * t + k];
+                    unsigned int x1 = indices[3 * t + (k + 1) % 3];
+                    unsigned int x2 = indices[3 * t + (k + 2) % 3];
+                    if (tornEdges.count(edgeKey(x0, x1))) continue;
+
+                    // the neighbour across the edge, visiting each edge once
+                    int other = -1;
+                    for (auto u : vertexTriangles[x0]) {
+                        if ((size_t)u <= t) continue;
+                        for (int a = 0; a < 3; a++) {
+                            if (indices[3 * u + a] == x1) other = u;
+                        }
+                    }
+                    if (other == -1) continue;
+                    unsigned int x3 = indices[3 * other];
+                    for (int a = 1; a < 3; a++) {
+                        if (x3 == x0 || x3 == x1) x3 = indices[3 * other + a];
+                    }
+
+                    vec3 e0 = restPositions[x1] - restPositions[x0];
+                    vec3 e1 = restPositions[x2] - restPositions[x0];
+                    vec3 e2 = restPositions[x3] - restPositions[x0];
+                    vec3 e3 = restPositions[x2] - restPositions[x1];
+                    vec3 e4 = restPositions[x3] - restPositions[x1];
+                    T c01 = cotangent(e0, e1), c02 = cotangent(e0, e2);
+                    T c03 = cotangent(-e0, e3), c04 = cotangent(-e0, e4);
+                    T area = (glm::length(glm::cross(e0, e1)) + glm::length(glm::cross(e0, e2))) / T(2);
+                    if (!(area > 0)) continue;
+
+                    unsigned int stencil[4] = {x0, x1, x2, x3};
+                    T K[4] = {c03 + c04, c01 + c02, -c01 - c03, -c02 - c04};
+                    for (int a = 0; a < 4; a++) {
+                        for (int b = 0; b < 4; b++) {
+                            Entry e = {(int)stencil[a], (int)stencil[b], T(3) / area * K[a] * K[b]};
+                            entries.push_back(e);
+                        }
+                    }
+                }
+            }
+
+            std::sort(entries.begin(), entries.end());
+            bendingStarts.assign(vertices.size() + 1, 0);
+            bendingColumns.clear();
+            bendingValues.clear();
+            for (size_t e = 0; e < entries.size(); e++) {
+                if (e > 0 && entries[e].row == entries[e - 1].row && entries[e].column == entries[e - 1].column) {
+                    bendingValues.back() += entries[e].value;
+                    continue;
+                }
+                bendingColumns.push_back(entries[e].column);
+                bendingValues.push_back(entries[e].value);
+                bendingStarts[entries[e].row + 1] = bendingColumns.size();
+            }
+            for (size_t i = 1; i < bendingStarts.size(); i++) {
+                bendingStarts[i] = std::max(bendingStarts[i], bendingStarts[i - 1]);
             }
         }
 
+        void buildAdjacency() {
+            vertexTriangles.assign(vertices.size(), std::vector<int>());
+            vertexSprings.assign(vertices.size(), std::vector<int>());
+            for (size_t i = 0; i < indices.size(); i++) {
+                vertexTriangles[indices[i]].push_back(i / 3);
+            }
+            for (size_t i = 0; i < springIndices.size(); i++) {
+                vertexSprings[springIndices[i]].push_back(i / 2);
+            }
+        }
+
+        void setIndex(size_t i, unsigned int v) {
+            indices[i] = v;
+            dirtyBegin = std::min(dirtyBegin, i);
+            dirtyEnd = std::max(dirtyEnd, i + 1);
+        }
+
+        // Swap-and-pop removal, patching the adjacency of the spring moved into the hole
+        void removeSpring(int s) {
+            int last = springDampers.size() - 1;
+            for (int k = 0; k < 2; k++) {
+                std::vector<int>& adjacent = vertexSprings[springIndices[2 * s + k]];
+                adjacent.erase(std::find(adjacent.begin(), adjacent.end(), s));
+            }
+            delete springDampers[s];
+
+            if (s != last) {
+                springDampers[s] = springDampers[last];
+                springIndices[2 * s] = springIndices[2 * last];
+                springIndices[2 * s + 1] = springIndices[2 * last + 1];
+                springForces[s] = springForces[last];
+                for (int k = 0; k < 2; k++) {
+                    std::vector<int>& adjacent = vertexSprings[springIndices[2 * s + k]];
+                    *std::find(adjacent.begin(), adjacent.end(), last) = s;
+                }
+            }
+            springDampers.pop_back();
+            springIndices.resize(2 * last);
+            springForces.pop_back();
+        }
+
+        // Swap-and-pop removal of a triangle and its three indices
+        void removeTriangle(int t) {
+            int last = triangles.size() - 1;
+            for (int k = 0; k < 3; k++) {
+                std::vector<int>& adjacent = vertexTriangles[indices[3 * t + k]];
+                adjacent.erase(std::find(adjacent.begin(), adjacent.end(), t));
+            }
+            delete triangles[t];
+
+            if (t != last) {
+                triangles[t] = triangles[last];
+                for (int k = 0; k < 3; k++) {
+                    setIndex(3 * t + k, indices[3 * last + k]);
+                    std::vector<int>& adjacent = vertexTriangles[indices[3 * t + k]];
+                    *std::find(adjacent.begin(), adjacent.end(), last) = t;
+                }
+            }
+            faceNormals[t] = faceNormals[last];
+            faceForces[t] = faceForces[last];
+            faceWinds[t] = faceWinds[last];
+            faceImpulses[t] = faceImpulses[last];
+            for (int k = 0; k < 3; k++) {
+                cornerForces[3 * t + k] = cornerForces[3 * last + k];
+            }
+            triangles.pop_back();
+            indices.resize(3 * last);
+            faceNormals.pop_back();
+            faceForces.pop_back();
+            faceWinds.pop_back();
+            faceImpulses.pop_back();
+            cornerForces.resize(3 * last);
+            dirtyEnd = std::min(dirtyEnd, indices.size());
+        }
+
+        bool isTornOff(int t) {
+            int torn = 0;
+            for (int k = 0; k < 3; k++) {
+                torn += tornEdges.count(edgeKey(indices[3 * t + k], indices[3 * t + (k + 1) % 3]));
+            }
+            return torn >= 2;
+        }
+
+        // Whether triangles t1 and t2 share an edge through v that has not been torn
+        bool sharesIntactEdge(int t1, int t2, unsigned int v) {
+            for (int a = 0; a < 3; a++) {
+                unsigned int w = indices[3 * t1 + a];
+                if (w == v || tornEdges.count(edgeKey(v, w))) continue;
+                for (int b = 0; b < 3; b++) {
+                    if (indices[3 * t2 + b] == w) return true;
+                }
+            }
+            return false;
+        }
+
+        // Duplicate v once for every extra connected piece of its triangle fan
+        void splitVertex(unsigned int v) {
+            std::vector<int> fan = vertexTriangles[v];
+            std::vector<int> component(fan.size(), -1);
+            int components = 0;
+            for (size_t seed = 0; seed < fan.size(); seed++) {
+                if (component[seed] != -1) continue;
+                component[seed] = components;
+                std::vector<size_t> stack(1, seed);
+                while (!stack.empty()) {
+                    size_t a = stack.back();
+                    stack.pop_back();
+                    for (size_t b = 0; b < fan.size(); b++) {
+                        if (component[b] == -1 && sharesIntactEdge(fan[a], fan[b], v)) {
+                            component[b] = components;
+                            stack.push_back(b);
+                        }
+                    }
+                }
+                components++;
+            }
+            if (components < 2) return;
+
+            // mass is shared between the pieces in proportion to their
+            // triangles, and so is the force, keeping their acceleration
+            std::vector<int> counts(components, 0);
+            for (auto c : component) counts[c]++;
+            T mass = vertices.mass[v];
+            vec3 force = vertices.force[v];
+            vertices.setMass(v, mass * counts[0] / fan.size());
+            vertices.force[v] = force * T(counts[0]) / T(fan.size());
+
+            std::vector<unsigned int> copies(components, v);
+            vertexTriangles[v].clear();
+            for (int c = 1; c < components; c++) {
+                copies[c] = vertices.size();
+                vertices.duplicate(v);
+                vertices.setMass(copies[c], mass * counts[c] / fan.size());
+                vertices.force[copies[c]] = force * T(counts[c]) / T(fan.size());
+                if (integrator == VERLET) previousPositions.push_back(previousPositions[v]);
+                positions.push_back(positions[v]);
+                normals.push_back(normals[v]);
+                restPositions.push_back(restPositions[v]);
+                gridCells.push_back(gridCells[v]);
+                vertexIds.push_back(vertexIndices.size());
+                vertexIndices.push_back(copies[c]);
+                vertexTriangles.push_back(std::vector<int>());
+                vertexSprings.push_back(std::vector<int>());
+                for (size_t a = 0; a < attachments.size(); a++) {
+                    if (attachments[a].vertex != (int)v) continue;
+                    Attachment<T> pinned = attachments[a];
+                    pinned.vertex = copies[c];
+                    attachments.push_back(pinned);
+                    break;
+                }
+            }
+
+            for (size_t k = 0; k < fan.size(); k++) {
+                unsigned int target = copies[component[k]];
+                vertexTriangles[target].push_back(fan[k]);
+                if (target == v) continue;
+                for (int a = 0; a < 3; a++) {
+                    unsigned int u = indices[3 * fan[k] + a];
+                    if (u == v) {
+                        setIndex(3 * fan[k] + a, target);
+                    }
+                    else if (tornEdges.count(edgeKey(v, u))) {
+                        tornEdges.insert(edgeKey(target, u));
+                    }
+                }
+            }
+
+            // springs follow the piece holding their other endpoint, or the
+            // piece facing it for springs that are not triangle edges
+            std::vector<int> springs = vertexSprings[v];
+            for (auto s : springs) {
+                int end = (springIndices[2 * s] == v) ? 0 : 1;
+                unsigned int w = springIndices[2 * s + 1 - end];
+                int piece = -1;
+                int facingPiece = 0;
+                T best = -std::numeric_limits<T>::max();
+                for (size_t k = 0; k < fan.size(); k++) {
+                    vec3 centroid(0);
+                    for (int a = 0; a < 3; a++) {
+                        unsigned int u = indices[3 * fan[k] + a];
+                        if (u == w) piece = component[k];
+                        centroid += vertices.position[u] / T(3);
+                    }
+                    T facing = glm::dot(centroid - vertices.position[v], vertices.position[w] - vertices.position[v]);
+                    if (facing > best) {
+                        best = facing;
+                        facingPiece = component[k];
+                    }
+                }
+                if (piece == -1) piece = facingPiece;
+                if (piece == 0) continue;
+
+                unsigned int target = copies[piece];
+                springIndices[2 * s + end] = target;
+                std::vector<int>& adjacent = vertexSprings[v];
+                adjacent.erase(std::find(adjacent.begin(), adjacent.end(), s));
+                vertexSprings[target].push_back(s);
+            }
+        }
+
+        void applyTears() {
+            regular = false;
+            std::sort(tornSprings.begin(), tornSprings.end(), std::greater<int>());
+            std::vector<unsigned int> ends;
+            for (auto s : tornSprings) {
+                unsigned int a = springIndices[2 * s];
+                unsigned int b = springIndices[2 * s + 1];
+                tornEdges.insert(edgeKey(a, b));
+                removeSpring(s);
+                ends.push_back(a);
+                ends.push_back(b);
+
+                // a triangle with two torn edges has a corner hanging free
+                // and nothing to keep it in shape, so it is dropped rather
+                // than split off
+                std::vector<int> fan = vertexTriangles[a];
+                std::sort(fan.begin(), fan.end(), std::greater<int>());
+                for (auto t : fan) {
+                    if (isTornOff(t)) removeTriangle(t);
+                }
+            }
+            tornSprings.clear();
+
+            for (auto v : ends) {
+                splitVertex(v);
+            }
+            buildBands(springIndices, 2, springBands);
+            buildBands(indices, 3, triangleBands);
+            if (springBands.back().size() > springDampers.size() / 32) {
+                renumber();
+            }
+            buildBending();
+            resizeCheckpoint();
+            resizeSleep();
+            topology++;
+            edits[topology % ClothFrame::history] = ClothFrame::Range(dirtyBegin, std::min(dirtyEnd, indices.size()));
+            dirtyBegin = indices.size();
+            dirtyEnd = 0;
+        }
+
+        // Renumber the vertices in the order of the grid cells they came
+        // from, every split vertex right after the one it was split from,
+        // then sort the elements by band again. A space-filling curve would
+        // scatter the neighbours of a row over distant indices and put every
+        // element in the overflow band, while the order of the grid keeps
+        // them within a band of each other, as reverse Cuthill-McKee would.
+        // Everything held per vertex or per element follows, and all bands
+        // wake, since their vertices change.
+        void renumber() {
+            int n = vertices.size();
+            std::vector<int> order(n);
+            std::vector<unsigned int> ranks(n);
+            for (int i = 0; i < n; i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {return gridCells[a] < gridCells[b];});
+            for (int r = 0; r < n; r++) ranks[order[r]] = r;
+
+            // vertices split off since the last implicit step take the
+            // solution of the first vertex of their cell
+            std::vector<int> cellVertex(width * height, -1);
+            for (int i = n - 1; i >= 0; i--) cellVertex[gridCells[i]] = i;
+            std::vector<vec3>& dv = solver.getSolution();
+            if (!dv.empty()) {
+                for (int i = dv.size(); i < n; i++) dv.push_back(dv[cellVertex[gridCells[i]]]);
+                permute(dv, order);
+            }
+            if (integrator == VERLET) permute(previousPositions, order);
+
+            permute(vertices.position, order);
+            permute(vertices.velocity, order);
+            permute(vertices.force, order);
+            permute(vertices.normal, order);
+            permute(vertices.mass, order);
+            permute(vertices.inverseMass, order);
+            permute(positions, order);
+            permute(normals, order);
+            permute(restPositions, order);
+            permute(gridCells, order);
+            permute(vertexIds, order);
+            for (int i = 0; i < n; i++) vertexIndices[vertexIds[i]] = i;
+            for (auto& i : indices) i = ranks[i];
+            for (auto& i : springIndices) i = ranks[i];
+            for (auto& a : attachments) a.vertex = ranks[a.vertex];
+            std::unordered_set<unsigned long long> edges;
+            for (auto key : tornEdges) {
+                edges.insert(edgeKey(ranks[key >> 32], ranks[key & 0xffffffffull]));
+            }
+            tornEdges.swap(edges);
+
+            // split vertices between the ends of a spring widen it
+            for (size_t s = 0; s < springIndices.size(); s += 2) {
+                bandSize = std::max(bandSize, (int)std::max(springIndices[s], springIndices[s + 1]) - (int)std::min(springIndices[s], springIndices[s + 1]) + 1);
+            }
+            std::vector<int> springOrder = sortByBand(springDampers, springIndices, 2);
+            permute(springForces, springOrder);
+            std::vector<int> triangleOrder = sortByBand(triangles, indices, 3);
+            permute(faceNormals, triangleOrder);
+            permute(faceForces, triangleOrder);
+            permute(faceWinds, triangleOrder);
+            permute(faceImpulses, triangleOrder);
+            permute(cornerForces, triangleOrder, 3);
+            dirtyBegin = 0;
+            dirtyEnd = indices.size();
+
+            buildAdjacency();
+            buildBands(springIndices, 2, springBands);
+            buildBands(indices, 3, triangleBands);
+            resizeSleep();
+            wakeAll();
+            renumberings++;
+        }
+
+        // Tears never add indices, so the index buffer made by the
+        // constructor holds them all and only the range edited is sent
+        void uploadIndices(const std::vector<unsigned int>& i, ClothFrame::Range r) {
+            if (r.first >= r.second) return;
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * r.first, sizeof(unsigned int) * (r.second - r.first), i.data() + r.first);
+        }
+
+        void uploadVertices(const std::vector<glm::vec3>& p, const std::vector<glm::vec3>& n) {
+            // Bind to the first VBO - We will use it to store the vertices
+            glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * p.size(), p.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+            // Bind to the second VBO - We will use it to store the normals
+            glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * n.size(), n.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+        }
+
+        // Phase kernels. Each one works on an index range so it can be run
+        // whole by step() or in chunks by the task graph from schedule().
+
+        // Pins have an inverse mass of 0, so every awake vertex moves alike
+        // and no loop branches on them; the explicit step runs over the
+        // arrays of each awake band as one loop of multiply-adds.
+        void integrate(int begin, int end) {
+            vec3* x = vertices.position.data();
+            vec3* v = vertices.velocity.data();
+            const vec3* f = vertices.force.data();
+            const T* w = vertices.inverseMass.data();
+            if (adaptive) {
+                forAwakeRuns(begin, end, [&](int b, int e) {
+                    std::copy(x + b, x + e, savedPositions.begin() + b);
+                    std::copy(f + b, f + e, savedForces.begin() + b);
+                    if (integrator == VERLET) {
+                        std::copy(previousPositions.begin() + b, previousPositions.begin() + e, savedPrevious.begin() + b);
+                    } else {
+                        std::copy(v + b, v + e, savedVelocities.begin() + b);
+                    }
+                });
+            }
+            if (integrator == VERLET) {
+                vec3* previous = previousPositions.data();
+                forAwake(begin, end, [&](int i) {
+                    vec3 last = x[i];
+                    x[i] = last + verletScale * (last - previous[i]) + (verletKick * w[i]) * f[i];
+                    previous[i] = last;
+                });
+                return;
+            }
+            if (integrator == EXPLICIT) {
+                forAwakeRuns(begin, end, [this](int b, int e) {vertices.move(b, e, timestep);});
+                return;
+            }
+            if (integrator == PROJECTIVE) {
+                if (!projectiveSolved) return;
+                const std::vector<vec3>& solution = projective.getSolution();
+                forAwake(begin, end, [&](int i) {
+                    v[i] = (solution[i] - x[i]) / timestep;
+                    x[i] = solution[i];
+                });
+                return;
+            }
+            const std::vector<vec3>& dv = solver.getSolution();
+            forAwake(begin, end, [&](int i) {
+                v[i] += dv[i];
+                x[i] += timestep * v[i];
+            });
+        }
+
+        // Pin a vertex where it is, to follow the track from there if any
+        void attach(int vertex, int track) {
+            Attachment<T> a = {vertex, track, vertices.position[vertex]};
+            if (track >= 0) {
+                glm::mat<4, 4, T, glm::defaultp> toTrack = glm::inverse(tracks[track].at(clock)) * glm::mat<4, 4, T, glm::defaultp>(model);
+                a.anchor = vec3(toTrack * glm::vec<4, T, glm::defaultp>(a.anchor, T(1)));
+            }
+            for (auto& b : attachments) {
+                if (b.vertex == vertex) {
+                    b = a;
+                    vertices.setFixed(vertex, !released);
+                    return;
+                }
+            }
+            attachments.push_back(a);
+            vertices.setFixed(vertex, !released);
+        }
+
+        // Serial, after integrate(): move the pins to where their targets
+        // are at the end of the substep. A pin asleep wakes its band once
+        // its target moves.
+        void applyAttachments() {
+            if (released || attachments.empty()) return;
+            typedef glm::mat<4, 4, T, glm::defaultp> mat4;
+            typedef glm::vec<4, T, glm::defaultp> vec4;
+            mat4 toModel(glm::inverse(model));
+            T h = timestep;
+            for (auto& a : attachments) {
+                vec3 start = a.anchor, target = a.anchor;
+                if (a.track >= 0) {
+                    start = vec3(toModel * (tracks[a.track].at(clock) * vec4(a.anchor, T(1))));
+                    target = vec3(toModel * (tracks[a.track].at(clock + h) * vec4(a.anchor, T(1))));
+                }
+                if (asleep(a.vertex)) {
+                    if (target == vertices.position[a.vertex]) continue;
+                    sleeping[a.vertex / bandSize] = 0;
+                    stillSteps[a.vertex / bandSize] = 0;
+                }
+                vertices.position[a.vertex] = target;
+                if (integrator == VERLET) {
+                    previousPositions[a.vertex] = start;
+                } else {
+                    vertices.velocity[a.vertex] = (target - start) / h;
+                }
+            }
+        }
+
+        // Pattern of the implicit system: the ends of every spring, the
+        // corners of every face and the bending stencils
+        void buildSystem() {
+            std::vector<std::pair<int, int> > pairs;
+            for (size_t s = 0; s < springIndices.size(); s += 2) {
+                pairs.push_back(std::make_pair(springIndices[s], springIndices[s + 1]));
+                pairs.push_back(std::make_pair(springIndices[s + 1], springIndices[s]));
+            }
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                for (int a = 0; a < 3; a++) {
+                    for (int b = 0; b < 3; b++) {
+                        if (a != b) pairs.push_back(std::make_pair(indices[t + a], indices[t + b]));
+                    }
+                }
+            }
+            for (size_t i = 0; i < vertices.size(); i++) {
+                for (int e = bendingStarts[i]; e < bendingStarts[i + 1]; e++) {
+                    pairs.push_back(std::make_pair((int)i, bendingColumns[e]));
+                }
+            }
+            int kept = solver.getSolution().size();
+            solver.getMatrix().setPattern(vertices.size(), pairs);
+            solver.resize();
+
+            // tears only ever append vertices, and renumber() carries the
+            // solution along, so the last solution still fits the old ones
+            // and the new ones take the solution of a vertex of their cell
+            std::vector<vec3>& dv = solver.getSolution();
+            std::vector<int> cellVertex(width * height, -1);
+            for (int i = kept - 1; i >= 0; i--) cellVertex[gridCells[i]] = i;
+            for (size_t i = kept; i < vertices.size(); i++) {
+                dv[i] = (cellVertex[gridCells[i]] >= 0) ? dv[cellVertex[gridCells[i]]] : vec3(0);
+            }
+            solver.setGrid(gridCells, height, width);
+            solverTopology = topology;
+        }
+
+        // Map the derivatives of the springs, or of the faces with the
+        // membrane model, and of the bending entries to their blocks
+        void buildAssembly() {
+            const BlockMatrix<T>& A = solver.getMatrix();
+            int elements = membrane ? 9 * triangles.size() : springDampers.size();
+            assembly.clear(A, elements + bendingColumns.size());
+            if (membrane) {
+                for (size_t t = 0; t < triangles.size(); t++) {
+                    for (int a = 0; a < 3; a++) {
+                        for (int c = 0; c < 3; c++) {
+                            assembly.add(indices[3 * t + a], indices[3 * t + c], 9 * t + 3 * a + c);
+                        }
+                    }
+                }
+            } else {
+                for (size_t s = 0; s < springDampers.size(); s++) {
+                    int i = springIndices[2 * s], j = springIndices[2 * s + 1];
+                    assembly.add(i, j, s);
+                    assembly.add(j, i, s);
+                    assembly.add(i, i, s, true);
+                    assembly.add(j, j, s, true);
+                }
+            }
+            for (size_t i = 0; i < vertices.size(); i++) {
+                for (int e = bendingStarts[i]; e < bendingStarts[i + 1]; e++) {
+                    assembly.add(i, bendingColumns[e], elements + e);
+                }
+            }
+            assembly.finish();
+            assemblyMembrane = membrane;
+        }
+
+        // Fill the system of an implicit step of the current length around
+        // the state and the forces of the last substep: the derivatives of
+        // every element side by side, then every row from the ones it takes
+        void assemble() {
+            typedef glm::mat<3, 3, T, glm::defaultp> mat3;
+            const int grain = 512;
+            if (solverTopology != topology) buildSystem();
+            BlockMatrix<T>& A = solver.getMatrix();
+            if (!assembly.current(A) || assemblyMembrane != membrane) buildAssembly();
+            std::vector<vec3>& b = solver.getRhs();
+            std::vector<char>& constrained = solver.getConstrained();
+            T h = timestep;
+
+            BlockMatrix<T>::forRange(pool, vertices.size(), grain, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) constrained[i] = vertices.isFixed(i) || asleep(i);
+            });
+
+            mat3* dx = assembly.getStiffness();
+            mat3* dv = assembly.getDamping();
+            int elements = membrane ? 9 * triangles.size() : springDampers.size();
+            if (membrane) {
+                BlockMatrix<T>::forRange(pool, triangles.size(), grain, [&](int begin, int end) {
+                    for (int t = begin; t < end; t++) {
+                        const unsigned int* c = &indices[3 * t];
+                        vec3 p[3] = {vertices.position[c[0]], vertices.position[c[1]], vertices.position[c[2]]};
+                        vec3 v[3] = {vertices.velocity[c[0]], vertices.velocity[c[1]], vertices.velocity[c[2]]};
+                        triangles[t]->membraneJacobian(material, p, v, reinterpret_cast<mat3(*)[3]>(dx + 9 * t), reinterpret_cast<mat3(*)[3]>(dv + 9 * t), true);
+                    }
+                });
+            } else {
+                BlockMatrix<T>::forRange(pool, springDampers.size(), 2 * grain, [&](int begin, int end) {
+                    for (int s = begin; s < end; s++) springDampers[s]->jacobian(springDelta(s), dx[s], dv[s]);
+                });
+            }
+            BlockMatrix<T>::forRange(pool, bendingColumns.size(), 4 * grain, [&](int begin, int end) {
+                for (int e = begin; e < end; e++) {
+                    dx[elements + e] = -bendingStiffness * bendingValues[e] * mat3(T(1));
+                    dv[elements + e] = -bendingDamping * bendingValues[e] * mat3(T(1));
+                }
+            });
+
+            assembly.assemble(pool, h, A, b, constrained, [this](int j) {return vertices.velocity[j];}, [&](int i) {
+                A.blocks[A.diagonals[i]] = constrained[i] ? mat3(T(1)) : vertices.mass[i] * mat3(T(1));
+                b[i] = constrained[i] ? vec3(0) : h * vertices.force[i];
+            });
+        }
+
+        void solveImplicit() {
+            assemble();
+            solver.solve(pool);
+        }
+
+        void buildProjective() {
+            std::vector<T> stiffness, damping, rest;
+            for (auto s : springDampers) {
+                stiffness.push_back(s->getStiffness());
+                damping.push_back(s->getDamping());
+                rest.push_back(s->getRestLength());
+            }
+            projective.setTopology(gridCells, springIndices, stiffness, damping, rest, bendingStarts, bendingColumns, bendingValues);
+            startPositions.resize(vertices.size());
+            targets.resize(vertices.size());
+            vertexMasses.resize(vertices.size());
+            projectiveConstrained.resize(vertices.size());
+            projectiveHeld.resize(vertices.size());
+            projectiveTopology = topology;
+        }
+
+        // Solve for the positions at the end of the substep; integrate()
+        // then moves the vertices there. A system that is not definite has
+        // no solution, so the vertices stay for the substep, which adaptive
+        // stepping rejects to retry it in halves, where the masses weigh
+        // more.
+        void solveProjective() {
+            if (projectiveTopology != topology) buildProjective();
+            T h = timestep;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                vec3 x = vertices.position[i];
+                vertexMasses[i] = vertices.mass[i];
+                projectiveConstrained[i] = vertices.isFixed(i);
+                projectiveHeld[i] = asleep(i);
+                startPositions[i] = x;
+                targets[i] = x + h * vertices.velocity[i] + (h * h * vertices.inverseMass[i]) * vertices.force[i];
+            }
+            projectiveSolved = projective.prepare(h, vertexMasses, projectiveConstrained, bendingStiffness, bendingDamping);
+            if (!projectiveSolved) {
+                if (adaptive) stepChange = std::numeric_limits<T>::quiet_NaN();
+                return;
+            }
+            projective.solve(startPositions, targets, projectiveHeld, pool);
+        }
+
+        // The coefficients of the substep. Once it is taken the positions
+        // are a step of its length apart, which velocityOf() reads from
+        // lastStep, so retryStep puts the old one back.
+        void prepareVerlet() {
+            verletScale = (T(1) - verletDamping) * timestep / lastStep;
+            verletKick = timestep * (timestep + lastStep) / T(2);
+            savedStep = lastStep;
+            lastStep = timestep;
+        }
+
+        void solveStep() {
+            if (integrator == IMPLICIT) {
+                solveImplicit();
+            } else if (integrator == PROJECTIVE) {
+                solveProjective();
+            } else if (integrator == VERLET) {
+                prepareVerlet();
+            }
+        }
+
+        void resizeCheckpoint() {
+            if (!adaptive) return;
+            savedPositions.resize(vertices.size());
+            savedVelocities.resize(vertices.size());
+            savedForces.resize(vertices.size());
+            savedPrevious.resize(vertices.size());
+        }
+
+        // Position of the second end of spring s relative to the first
+        vec3 springDelta(int s) {
+            return vertices.position[springIndices[2 * s + 1]] - vertices.position[springIndices[2 * s]];
+        }
+
+        // One Gauss-Seidel sweep of the strain limits over a band of springs,
+        // which reach from their band of vertices into the next. The ends
+        // take the velocity of their correction, which Verlet steps keep
+        // in the positions alone.
+        void limitStrain(int band) {
+            const int* batch = springBands[band].data();
+            SpringDamper<T>* const* springs = springDampers.data();
+            int end = springBands[band].size();
+            bool overflow = band == (int)springBands.size() - 1;
+            if (!overflow && sleeping[band] && (band + 1 >= (int)sleeping.size() || sleeping[band + 1])) return;
+            bool velocities = integrator != VERLET;
+            for (int k = 0; k < end; k++) {
+                unsigned int a = springIndices[2 * batch[k]], b = springIndices[2 * batch[k] + 1];
+                if (overflow && asleep(a) && asleep(b)) continue;
+                T wa = vertices.inverseMass[a], wb = vertices.inverseMass[b];
+                vec3 correction = springs[batch[k]]->strainCorrection(springDelta(batch[k]), wa, wb, strainLower, strainUpper);
+                if (correction == vec3(0)) continue;
+                vertices.position[a] += wa * correction;
+                vertices.position[b] -= wb * correction;
+                if (!velocities) continue;
+                vertices.velocity[a] += wa * correction / timestep;
+                vertices.velocity[b] -= wb * correction / timestep;
+            }
+        }
+
+        void limitStrains() {
+            // same order as the task graph: even bands, odd bands, overflow
+            for (int parity = 0; parity < 2; parity++) {
+                for (int b = parity; b < (int)springBands.size() - 1; b += 2) {
+                    limitStrain(b);
+                }
+            }
+            limitStrain(springBands.size() - 1);
+        }
+
+        void collide(const std::vector<Collider<T> >& colliders, int begin, int end) {
+            glm::mat<4, 4, T, glm::defaultp> toModel(glm::inverse(model));
+            for (auto& c : colliders) {
+                Collider<T> local = c.transformed(toModel);
+                forAwake(begin, end, [&](int i) {
+                    if (vertices.isFixed(i)) return;
+                    if (integrator != VERLET) {
+                        local.resolve(vertices.position[i], vertices.velocity[i]);
+                        return;
+                    }
+                    vec3 x = vertices.position[i];
+                    vec3 v = velocityOf(i);
+                    local.resolve(x, v);
+                    if (x == vertices.position[i]) return;
+                    vertices.position[i] = x;
+                    previousPositions[i] = x - lastStep * v;
+                });
+            }
+        }
+
+        // Normal, wind force and membrane forces of the count faces listed,
+        // a batch of triangles at a time. The last batch repeats its final
+        // triangle in unused lanes. Batches with every corner asleep keep
+        // their forces and only look for a change of wind.
+        void updateFaces(const int* faces, int count) {
+            const int lanes = FaceBatch<T>::lanes;
+            FaceBatch<T> batch;
+            for (int l = 0; l < lanes; l++) {
+                for (int k = 0; k < 3; k++) {
+                    batch.wind[k][l] = pointWind[k];
+                }
+            }
+            glm::mat<4, 4, T, glm::defaultp> toWorld(model);
+            glm::mat<4, 4, T, glm::defaultp> toModel(glm::inverse(model));
+            bool resample = windField && windField->getVersion() != windVersion;
+            std::vector<int> wakes;
+
+            for (int f = 0; f < count; f += lanes) {
+                const int* t = faces + f;
+                int n = std::min(lanes, count - f);
+                bool awake = facesAwake(t, n);
+                if (!awake && !resample) {
+                    addImpulses(t, n, timestep);
+                    continue;
+                }
+                for (int l = 0; l < lanes; l++) {
+                    loadFace(batch, l, t[std::min(l, n - 1)], membraneForces() && awake);
+                }
+                if (resample) {
+                    sampleWind(batch, toWorld, toModel);
+                    if (!awake) {
+                        checkWind(batch, t, n, wakes);
+                        addImpulses(t, n, timestep);
+                        continue;
+                    }
+                    for (int l = 0; l < n; l++) {
+                        faceWinds[t[l]] = vec3(batch.wind[0][l], batch.wind[1][l], batch.wind[2][l]);
+                    }
+                } else if (windField) {
+                    for (int l = 0; l < lanes; l++) {
+                        const vec3& w = faceWinds[t[std::min(l, n - 1)]];
+                        batch.wind[0][l] = w.x;
+                        batch.wind[1][l] = w.y;
+                        batch.wind[2][l] = w.z;
+                    }
+                }
+                batch.computeWind();
+                for (int l = 0; l < n; l++) {
+                    faceNormals[t[l]] = vec3(batch.normal[0][l], batch.normal[1][l], batch.normal[2][l]);
+                    faceForces[t[l]] = vec3(batch.force[0][l], batch.force[1][l], batch.force[2][l]);
+                }
+                if (membraneForces()) {
+                    batch.computeMembrane(material);
+                    for (int l = 0; l < n; l++) {
+                        for (int c = 0; c < 3; c++) {
+                            cornerForces[3 * t[l] + c] = vec3(batch.corner[c][0][l], batch.corner[c][1][l], batch.corner[c][2][l]);
+                        }
+                    }
+                }
+                addImpulses(t, n, timestep);
+            }
+            if (!wakes.empty()) {
+                std::lock_guard<std::mutex> guard(wakeLock);
+                wakeRequests.insert(wakeRequests.end(), wakes.begin(), wakes.end());
+            }
+        }
+
+        // Copy face t into one lane of a batch, with what the membrane model
+        // needs when asked to
+        void loadFace(FaceBatch<T>& batch, int lane, int t, bool withMembrane) {
+            const unsigned int* c = &indices[3 * t];
+            const vec3* x = vertices.position.data();
+            vec3 v[3] = {velocityOf(c[0]), velocityOf(c[1]), velocityOf(c[2])};
+            triangles[t]->load(batch, lane, x[c[0]], x[c[1]], x[c[2]], v[0] + v[1] + v[2]);
+            if (withMembrane) triangles[t]->loadMembrane(batch, lane, v[0], v[1], v[2]);
+        }
+
+        // The air takes the opposite of the force on all three corners
+        void addImpulses(const int* faces, int count, T dt) {
+            if (!airGrid) return;
+            for (int l = 0; l < count; l++) {
+                faceImpulses[faces[l]] -= T(3) * dt * faceForces[faces[l]];
+            }
+        }
+
+        // Ask to wake the bands of the faces whose wind has moved away from
+        // the one their forces were computed with
+        void checkWind(const FaceBatch<T>& batch, const int* faces, int count, std::vector<int>& wakes) {
+            for (int l = 0; l < count; l++) {
+                vec3 w = vec3(batch.wind[0][l], batch.wind[1][l], batch.wind[2][l]);
+                if (glm::length(w - faceWinds[faces[l]]) <= wakeWind) continue;
+                for (int k = 0; k < 3; k++) {
+                    wakes.push_back(indices[3 * faces[l] + k] / bandSize);
+                }
+            }
+        }
+
+        // Fill the wind of a batch from the field at the face centroids
+        void sampleWind(FaceBatch<T>& batch, const glm::mat<4, 4, T, glm::defaultp>& toWorld, const glm::mat<4, 4, T, glm::defaultp>& toModel) {
+            const int lanes = FaceBatch<T>::lanes;
+            T centroid[3][lanes];
+            for (int l = 0; l < lanes; l++) {
+                vec3 c = vec3(batch.p1[0][l] + batch.p2[0][l] + batch.p3[0][l],
+                              batch.p1[1][l] + batch.p2[1][l] + batch.p3[1][l],
+                              batch.p1[2][l] + batch.p2[2][l] + batch.p3[2][l]) / T(3);
+                for (int k = 0; k < 3; k++) {
+                    centroid[k][l] = toWorld[0][k] * c.x + toWorld[1][k] * c.y + toWorld[2][k] * c.z + toWorld[3][k];
+                }
+            }
+            windField->sample(centroid[0], centroid[1], centroid[2], batch.wind[0], batch.wind[1], batch.wind[2], lanes);
+
+            // velocities are directions, so only the linear part applies
+            for (int l = 0; l < lanes; l++) {
+                vec3 w = vec3(batch.wind[0][l], batch.wind[1][l], batch.wind[2][l]);
+                for (int k = 0; k < 3; k++) {
+                    batch.wind[k][l] = toModel[0][k] * w.x + toModel[1][k] * w.y + toModel[2][k] * w.z;
+                }
+            }
+        }
+
+        // Each vertex gathers the normals, wind forces and membrane forces
+        // of its own triangles and the forces of its springs, so no two
+        // chunks ever write the same vertex. Projective dynamics keeps only
+        // the forces of the faces.
+        void updateVertices(int begin, int end) {
+            bool projected = integrator == PROJECTIVE;
+            bool stencils = stencilSprings();
+            bool damped = airDamping > 0;
+            T change = 0;
+            T speed = 0;
+            forAwake(begin, end, [&](int i) {
+                vec3 normal = vec3(0);
+                vec3 force = vec3(0);
+                vec3 air = vec3(0);
+                for (auto t : vertexTriangles[i]) {
+                    normal += faceNormals[t];
+                    force += faceForces[t];
+                    if (damped) air += windField ? faceWinds[t] : pointWind;
+                    if (membraneForces()) {
+                        int c = (indices[3 * t] == (unsigned int)i) ? 0 : (indices[3 * t + 1] == (unsigned int)i) ? 1 : 2;
+                        force += cornerForces[3 * t + c];
+                    }
+                }
+                if (stencils) {
+                    for (int f = 0; f < stencilCount; f++) {
+                        const vec3* forces = &stencilForces[f * width * height];
+                        force += forces[i];
+                        if (i >= stencilSteps[f]) force -= forces[i - stencilSteps[f]];
+                    }
+                } else if (!membrane && !projected) {
+                    for (auto s : vertexSprings[i]) {
+                        force += (springIndices[2 * s] == (unsigned int)i) ? springForces[s] : -springForces[s];
+                    }
+                }
+                if (normal != vec3(0)) {
+                    vertices.normal[i] = glm::normalize(normal);
+                }
+                for (int e = bendingStarts[i]; e < bendingStarts[i + 1] && !projected; e++) {
+                    int j = bendingColumns[e];
+                    force -= bendingValues[e] * (bendingStiffness * vertices.position[j] + bendingDamping * velocityOf(j));
+                }
+                if (damped && !vertexTriangles[i].empty()) {
+                    air /= T(vertexTriangles[i].size());
+                    force += vertices.mass[i] * airDamping * (air - velocityOf(i));
+                }
+                // gravity as a force, so pinned vertices, of inverse mass 0,
+                // take no acceleration from it
+                force += vertices.mass[i] * gravity;
+                if (adaptive && !vertices.isFixed(i)) {
+                    keepLargest(change, vertices.inverseMass[i] * glm::length(force - vertices.force[i]));
+                    keepLargest(speed, glm::length(velocityOf(i)));
+                }
+                vertices.force[i] = force;
+            });
+            if (adaptive) {
+                std::lock_guard<std::mutex> guard(errorLock);
+                keepLargest(stepChange, change);
+                keepLargest(stepSpeed, speed);
+            }
+        }
+
+        // Forces of a family of springs of the grid from the vertices
+        // [begin, end) to DI rows and DJ columns on. The long families
+        // (Every = 2) only start on even rows and columns short of the last
+        // two, as the constructor builds them.
+        template <int DI, int DJ, int Every>
+        void updateStencil(int f, int begin, int end) {
+            vec3* forces = &stencilForces[f * width * height];
+            int step = DI * width + DJ;
+            int rows = std::min(height - DI, (Every == 2) ? height - 2 : height);
+            int first = std::max(0, -DJ);
+            int last = std::min(width - std::max(0, DJ), (Every == 2) ? width - 2 + first : width);
+            bool sleepy = sleepEnergy > 0;
+            for (int i = begin / width; i * width < end && i < rows; i++) {
+                if (Every == 2 && i % 2 != 0) continue;
+                int j = std::max(first, begin - i * width);
+                int stop = std::min(last, end - i * width);
+                if (Every == 2) j += (j - first) & 1;
+                for (; j < stop; j += Every) {
+                    int v = i * width + j;
+                    if (sleepy && asleep(v) && asleep(v + step)) continue;
+                    forces[v] = SpringDamper<T>::computeForce(vertices.position[v + step] - vertices.position[v], velocityOf(v + step) - velocityOf(v),
+                                                              springStiffness, springDamping, stencilRest[f]);
+                }
+            }
+        }
+
+        // The springs of a band, by the stencils
+        void updateStencils(int band) {
+            int begin = band * bandSize;
+            int end = std::min((int)vertices.size(), begin + bandSize);
+            updateStencil<0, 1, 1>(0, begin, end);
+            updateStencil<1, 0, 1>(1, begin, end);
+            updateStencil<1, 1, 1>(2, begin, end);
+            updateStencil<1, -1, 1>(3, begin, end);
+            if (stencilCount == 8) {
+                updateStencil<0, 2, 2>(4, begin, end);
+                updateStencil<2, 0, 2>(5, begin, end);
+                updateStencil<2, 2, 2>(6, begin, end);
+                updateStencil<2, -2, 2>(7, begin, end);
+            }
+        }
+
+        void updateSprings(const int* springs, int count) {
+            for (int k = 0; k < count; k++) {
+                int s = springs[k];
+                unsigned int a = springIndices[2 * s], b = springIndices[2 * s + 1];
+                if (asleep(a) && asleep(b)) continue;
+                if (!springDampers[s]->computeForce(springDelta(s), velocityOf(b) - velocityOf(a), springForces[s])) {
+                    std::lock_guard<std::mutex> guard(tearLock);
+                    tornSprings.push_back(s);
+                }
+            }
+        }
+
+        // Forces of the faces and springs of a band
+        void updateElements(int band) {
+            updateFaces(triangleBands[band].data(), triangleBands[band].size());
+            if (stencilSprings()) {
+                updateStencils(band);
+            } else if (springsNeeded()) {
+                updateSprings(springBands[band].data(), springBands[band].size());
+            }
+        }
+
+        void gatherBand(int band) {
+            updateVertices(band * bandSize, std::min((int)vertices.size(), (band + 1) * bandSize));
+        }
+
+        // The force pass over the bands [begin, end) as tiles, once the
+        // overflow band is done. The first band of the range also takes
+        // forces from the band before, so unless it is the first band of
+        // all it is left for gatherBand once that band is done too.
+        void updateTiles(int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                updateElements(b);
+                if (b > begin || b == 0) gatherBand(b);
+            }
+        }
+
+        // The membrane model and projective dynamics only need the springs
+        // to find tears
+        bool springsNeeded() {return (!membrane && integrator != PROJECTIVE) || tearStrain > 0;}
+
+        // Only the spring arrays find the springs that tear
+        bool stencilSprings() {return regular && tearStrain == 0 && !membrane && integrator != PROJECTIVE;}
+
+        bool membraneForces() {return membrane && integrator != PROJECTIVE;}
+
+        // largest = max(largest, x), except that a NaN, once in, stays in
+        static void keepLargest(T& largest, T x) {
+            if (!(x <= largest) && largest == largest) largest = x;
+        }
+
+        // Size the next step from the error of this one, and tell whether
+        // this one may stand. NaN never does, unless the step is already
+        // the smallest allowed.
+        bool acceptStep() {
+            T error = stepChange * timestep * timestep / T(2);
+            T scale = T(2);
+            if (!(error <= 0)) {
+                scale = (error == error) ? T(0.9) * std::sqrt(tolerance / error) : T(0.5);
+            }
+            T next = timestep * std::min(T(2), std::max(T(0.5), scale));
+            if (stepSpeed > 0) {
+                next = std::min(next, T(0.25) * spacing / stepSpeed);
+            }
+            bool accepted = error <= T(4) * tolerance || timestep <= minStep;
+            stepLimit = accepted ? std::min(maxStep, stepLimit * T(1.002)) : T(0.9) * timestep;
+            proposedStep = std::min(stepLimit, std::max(minStep, next));
+            stepChange = 0;
+            stepSpeed = 0;
+            return accepted;
+        }
+
+        // Undo a substep and cover its time with two of half the length
+        void retryStep(const std::vector<Collider<T> >& colliders) {
+            forAwakeRuns(0, vertices.size(), [this](int b, int e) {
+                std::copy(savedPositions.begin() + b, savedPositions.begin() + e, vertices.position.begin() + b);
+                std::copy(savedForces.begin() + b, savedForces.begin() + e, vertices.force.begin() + b);
+                if (integrator == VERLET) {
+                    std::copy(savedPrevious.begin() + b, savedPrevious.begin() + e, previousPositions.begin() + b);
+                } else {
+                    std::copy(savedVelocities.begin() + b, savedVelocities.begin() + e, vertices.velocity.begin() + b);
+                }
+            });
+            if (integrator == VERLET) lastStep = savedStep;
+            tornSprings.clear();
+            wakeRequests.clear();
+            if (airGrid) {
+                for (size_t t = 0; t < triangles.size(); t++) {
+                    faceImpulses[t] += T(3) * timestep * faceForces[t];
+                }
+            }
+
+            T dt = timestep;
+            timestep = dt / T(2);
+            step(colliders);
+            step(colliders);
+            timestep = dt;
+        }
+
+        // Serial end of a substep, once every phase is done
+        void finishStep(const std::vector<Collider<T> >& colliders) {
+            if (adaptive && !acceptStep()) {
+                rejections++;
+                retryStep(colliders);
+                return;
+            }
+            clock += timestep;
+            lastStep = timestep;
+            for (auto& track : tracks) {
+                track.dropBefore(clock);
+            }
+            if (!tornSprings.empty()) {
+                applyTears();
+            }
+            if (windField) {
+                windVersion = windField->getVersion();
+            }
+            if (std::find(sleeping.begin(), sleeping.end(), 0) != sleeping.end()) {
+                motion++;
+            }
+            updateSleep();
+        }
+
+        // Refresh the normals and the forces of every vertex
+        void updateAcceleration() {
+            updateElements(vertexBands());
+            updateTiles(0, vertexBands());
+        }
+
     public:
-        Cloth(int width, int height, glm::vec3 offset)  {
+        Cloth(int width, int height, glm::vec3 offset, bool bendingSprings = false)  {
+            this->width = width;
+            this->height = height;
             // model matrix and color
             model = glm::translate(offset) * glm::mat4(1.0f);
             color = glm::vec3(1.0f, 0.1f, 0.1f);
+            pointWind = vec3(0);
+            windField = nullptr;
+            windVersion = ~0ull;
+            airGrid = nullptr;
+            timestep = T(0.001);
+            bendingStiffness = T(0.05);
+            bendingDamping = T(0.0005);
+            membrane = false;
+            integrator = EXPLICIT;
+            implicitStep = T(0.01);
+            pool = nullptr;
+            solverTopology = ~0ull;
+            assemblyMembrane = false;
+            projectiveTopology = ~0ull;
+            projectiveSolved = true;
+            lastStep = timestep;
+            verletDamping = T(0.001);
+            verletScale = verletKick = 0;
+            savedStep = lastStep;
+            adaptive = false;
+            tolerance = T(1e-4);
+            minStep = T(0.0002);
+            maxStep = T(0.004);
+            proposedStep = timestep;
+            stepLimit = maxStep;
+            spacing = T(0.1);       // of the grid built below
+            stepChange = 0;
+            stepSpeed = 0;
+            rejections = 0;
+            sleepEnergy = 0;
+            sleepSteps = 100;
+            wakeWind = T(0.1);
+            motion = 0;
+            uploadedMotion = ~0ull;
+            strainLower = T(0.5);
+            strainUpper = T(1.2);
+            translation = glm::vec3(0);
+            released = false;
+            clock = 0;
+            gravity = vec3(glm::inverse(model) * glm::vec4(0, -9.8, 0, 0));
+            airDamping = 0;
+            tearStrain = 0;
+            renumberings = 0;
             for (int i = 0; i < height; i++) {
                 for (int j = 0; j < width; j++) {
-                    glm::vec3 pos = glm::vec3(-0.1 * width / 2, 0.1 * height / 2, 0) + glm::vec3(i) * glm::vec3(0, -0.1, 0) + glm::vec3(j) * glm::vec3(0.1, 0, 0);
-                    Vertex* vertex = new Vertex(0.1f, pos, glm::vec3(0.1));
-                    vertices.push_back(vertex);
-                    positions.push_back(pos);
+                    vec3 pos = vec3(-0.1 * width / 2, 0.1 * height / 2, 0) + vec3(i) * vec3(0, -0.1, 0) + vec3(j) * vec3(0.1, 0, 0);
+                    vertices.add(T(0.1), pos, vec3(0.1));
+                    positions.push_back(glm::vec3(pos));
+                    restPositions.push_back(pos);
+                    gridCells.push_back(i * width + j);
+                    vertexIds.push_back(i * width + j);
+                    vertexIndices.push_back(i * width + j);
                     if (i == 0) {
-                        vertex->fix();
-                        indexFixed.push_back(i * width + j);
+                        attach(i * width + j, -1);
                     }
                 }
             }
@@ -79,11 +1628,7 @@ class Cloth {
                     int t1 = i * width + j;
                     int t2 = (i + 1) * width + j;
                     int t3 = i * width + j + 1;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    Vertex* v3 = vertices[t3];
-
-                    Triangle* triangle = new Triangle(v1, v2, v3);
+                    Triangle<T>* triangle = new Triangle<T>(vertices.position[t1], vertices.position[t2], vertices.position[t3]);
 
                     indices.push_back(t1);
                     indices.push_back(t2);
@@ -98,10 +1643,7 @@ class Cloth {
                     int t1 = i * width + j;
                     int t2 = i * width + j + 1;
                     int t3 = (i - 1) * width + j + 1;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    Vertex* v3 = vertices[t3];
-                    Triangle* triangle = new Triangle(v1, v2, v3);
+                    Triangle<T>* triangle = new Triangle<T>(vertices.position[t1], vertices.position[t2], vertices.position[t3]);
 
                     indices.push_back(t1);
                     indices.push_back(t2);
@@ -115,11 +1657,7 @@ class Cloth {
                 for (int j = 0; j < width - 1; j++) {
                     int t1 = i * width + j;
                     int t2 = i * width + j + 1;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.1);
-
-                    springDampers.push_back(springDamper);
+                    addSpringDamper(t1, t2, 0.1);
                 }
             }
 
@@ -128,11 +1666,7 @@ class Cloth {
                 for (int j = 0; j < width; j++) {
                     int t1 = i * width + j;
                     int t2 = (i + 1) * width + j;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.1);
-
-                    springDampers.push_back(springDamper);
+                    addSpringDamper(t1, t2, 0.1);
                 }
             }
 
@@ -141,11 +1675,7 @@ class Cloth {
                 for (int j = 0; j < width - 1; j++) {
                     int t1 = i * width + j;
                     int t2 = (i + 1) * width + j + 1;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.1 * glm::sqrt(2));
-
-                    springDampers.push_back(springDamper);
+                    addSpringDamper(t1, t2, 0.1 * glm::sqrt(2));
                 }
             }
 
@@ -154,71 +1684,92 @@ class Cloth {
                 for (int j = 0; j < width - 1; j++) {
                     int t1 = i * width + j;
                     int t2 = (i - 1) * width + j + 1;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.1 * glm::sqrt(2));
-
-                    springDampers.push_back(springDamper);
+                    addSpringDamper(t1, t2, 0.1 * glm::sqrt(2));
                 }
             }
 
-            // horizontal spring damper, large
-            for (int i = 0; i < height - 2; i += 2) {
-                for (int j = 0; j < width - 2; j += 2) {
-                    int t1 = i * width + j;
-                    int t2 = i * width + j + 2;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.2);
+            // Long springs over two cells used to be the only bending
+            // resistance, and are still there for comparison
+            stencilCount = bendingSprings ? 8 : 4;
+            if (bendingSprings) {
+                // horizontal spring damper, large
+                for (int i = 0; i < height - 2; i += 2) {
+                    for (int j = 0; j < width - 2; j += 2) {
+                        int t1 = i * width + j;
+                        int t2 = i * width + j + 2;
+                        addSpringDamper(t1, t2, 0.2);
+                    }
+                }
 
-                    springDampers.push_back(springDamper);
+                // vertical spring damper, large
+                for (int i = 0; i < height - 2; i += 2) {
+                    for (int j = 0; j < width - 2; j += 2) {
+                        int t1 = i * width + j;
+                        int t2 = (i + 2) * width + j;
+                        addSpringDamper(t1, t2, 0.2);
+                    }
                 }
-            }
 
-            // vertical spring damper, large
-            for (int i = 0; i < height - 2; i += 2) {
-                for (int j = 0; j < width - 2; j += 2) {
-                    int t1 = i * width + j;
-                    int t2 = (i + 2) * width + j;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.2);
+                // Upper Left to Lower Right diagonal spring damper, large
+                for (int i = 0; i < height - 2; i += 2) {
+                    for (int j = 0; j < width - 2; j += 2) {
+                        int t1 = i * width + j;
+                        int t2 = (i + 2) * width + j + 2;
+                        addSpringDamper(t1, t2, 0.2 * glm::sqrt(2));
+                    }
+                }
 
-                    springDampers.push_back(springDamper);
+                // Lower Left to Upper Right diagonal spring damper, large
+                for (int i = 2; i < height; i += 2) {
+                    for (int j = 0; j < width - 2; j += 2) {
+                        int t1 = i * width + j;
+                        int t2 = (i - 2) * width + j + 2;
+                        addSpringDamper(t1, t2, 0.2 * glm::sqrt(2));
+                    }
                 }
             }
 
-            // Upper Left to Lower Right diagonal spring damper, large
-            for (int i = 0; i < height - 2; i += 2) {
-                for (int j = 0; j < width - 2; j += 2) {
-                    int t1 = i * width + j;
-                    int t2 = (i + 2) * width + j + 2;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.2 * glm::sqrt(2));
+            regular = true;
+            int steps[8] = {1, width, width + 1, width - 1, 2, 2 * width, 2 * width + 2, 2 * width - 2};
+            T rest[8] = {T(0.1), T(0.1), T(0.1 * glm::sqrt(2)), T(0.1 * glm::sqrt(2)),
+                         T(0.2), T(0.2), T(0.2 * glm::sqrt(2)), T(0.2 * glm::sqrt(2))};
+            std::copy(steps, steps + 8, stencilSteps);
+            std::copy(rest, rest + 8, stencilRest);
+            springStiffness = springDampers.empty() ? T(0) : springDampers[0]->getStiffness();
+            springDamping = springDampers.empty() ? T(0) : springDampers[0]->getDamping();
+            stencilForces.assign(stencilCount * width * height, vec3(0));
 
-                    springDampers.push_back(springDamper);
-                }
+            // bands must be wider than any element's index span
+            bandSize = 128;
+            for (size_t s = 0; s < springIndices.size(); s += 2) {
+                bandSize = std::max(bandSize, (int)std::max(springIndices[s], springIndices[s + 1]) - (int)std::min(springIndices[s], springIndices[s + 1]) + 1);
             }
+            sortByBand(springDampers, springIndices, 2);
+            sortByBand(triangles, indices, 3);
 
-            // Lower Left to Upper Right diagonal spring damper, large
-            for (int i = 2; i < height; i += 2) {
-                for (int j = 0; j < width - 2; j += 2) {
-                    int t1 = i * width + j;
-                    int t2 = (i - 2) * width + j + 2;
-                    Vertex* v1 = vertices[t1];
-                    Vertex* v2 = vertices[t2];
-                    SpringDamper* springDamper = new SpringDamper(v1, v2, 0.2 * glm::sqrt(2));
+            buildAdjacency();
+            buildBending();
+            dirtyBegin = indices.size();
+            dirtyEnd = 0;
+            indexCount = indices.size();
+            topology = 0;
+            uploadedTopology = 0;
+            edits.assign(ClothFrame::history, ClothFrame::Range(0, 0));
 
-                    springDampers.push_back(springDamper);
-                }
-            }
+            buildBands(springIndices, 2, springBands);
+            buildBands(indices, 3, triangleBands);
+            resizeSleep();
+            springForces.resize(springDampers.size());
+            faceNormals.resize(triangles.size());
+            faceForces.resize(triangles.size());
+            faceWinds.resize(triangles.size());
+            faceImpulses.resize(triangles.size());
+            cornerForces.resize(3 * triangles.size());
 
-            updateNormal();
             updateAcceleration();
 
-            for (auto vertex : vertices) {
-                normals.push_back(vertex->normal);
+            for (auto& normal : vertices.normal) {
+                normals.push_back(glm::vec3(normal));
             }
             
             // Generate a vertex array (VAO) and two vertex buffer objects (VBO).
@@ -257,6 +1808,15 @@ class Cloth {
 
             // get the locations and send the uniforms to the shader 
             glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMatrix);
+
+            draw(shader);
+
+            // Unbind the shader program
+            glUseProgram(0);
+        }
+
+        // Draw with the shader already bound and its viewProj uniform set
+        void draw(GLuint shader) {
             glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, (float*)&model);
             glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &color[0]);
 
@@ -264,55 +1824,436 @@ class Cloth {
             glBindVertexArray(VAO);
 
             // display the points using triangles, indexed with the EBO
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
 
-            // Unbind the VAO and shader program
+            // Unbind the VAO
             glBindVertexArray(0);
-            glUseProgram(0);
         }
 
         void update() {
-            for (auto v : vertices) {
-                v->move(0.001);
+            step();
+            upload();
+        }
+
+        // Advance the simulation by one substep. Touches no GL state, so
+        // independent cloths can step on different threads.
+        void step(const std::vector<Collider<T> >& colliders = std::vector<Collider<T> >()) {
+            solveStep();
+            integrate(0, vertices.size());
+            applyAttachments();
+            limitStrains();
+            if (!colliders.empty()) {
+                collide(colliders, 0, vertices.size());
             }
 
-            updateNormal();
             updateAcceleration();
+            finishStep(colliders);
+        }
+
+        // Add the phases of one substep to the graph, chunked, after node
+        // `after`, and return the node that finishes the substep. Nodes of
+        // other cloths interleave freely.
+        int schedule(TaskGraph& graph, int after, const std::vector<Collider<T> >* colliders) {
+            const int grain = 512;
+            TaskGraph::Size vertexCount = [this] {return (int)vertices.size();};
+            TaskGraph::Size bandCount = [this] {return vertexBands();};
+            TaskGraph::Size overflowFaces = [this] {return (int)triangleBands.back().size();};
+            TaskGraph::Size overflowSprings = [this] {return (int)springBands.back().size();};
+
+            if (integrator != EXPLICIT) {
+                // the solvers run their own kernels on the pool
+                int solved = graph.add([this] {solveStep();});
+                graph.precede(after, solved);
+                after = solved;
+            }
+            int last = graph.add(vertexCount, grain, [this](int b, int e) {integrate(b, e);});
+            graph.precede(after, last);
+            int attached = graph.add([this] {applyAttachments();});
+            graph.precede(last, attached);
+            last = attached;
+
+            // one chunk per band, even bands then odd bands then the overflow
+            for (int parity = 0; parity < 2; parity++) {
+                int batch = graph.add([this, parity] {return bandsOfParity(springBands, parity);}, 1, [this, parity](int b, int e) {
+                    for (int k = b; k < e; k++) limitStrain(2 * k + parity);
+                });
+                graph.precede(last, batch);
+                last = batch;
+            }
+            int overflow = graph.add([this] {limitStrain(springBands.size() - 1);});
+            graph.precede(last, overflow);
+            last = overflow;
+
+            if (colliders && !colliders->empty()) {
+                int collided = graph.add(vertexCount, grain, [this, colliders](int b, int e) {collide(*colliders, b, e);});
+                graph.precede(last, collided);
+                last = collided;
+            }
+
+            // the overflow elements reach into any band, so they go first,
+            // faces and springs side by side; then the tiles, as many bands
+            // per chunk as make up a grain of vertices, and last the first
+            // band of every chunk after the first
+            int tileGrain = std::max(1, grain / bandSize);
+            int faces = graph.add(overflowFaces, grain, [this](int b, int e) {updateFaces(&triangleBands.back()[b], e - b);});
+            graph.precede(last, faces);
+            int tiles = graph.add(bandCount, tileGrain, [this](int b, int e) {updateTiles(b, e);});
+            graph.precede(faces, tiles);
+            if (springsNeeded()) {
+                int springs = graph.add(overflowSprings, 2 * grain, [this](int b, int e) {updateSprings(&springBands.back()[b], e - b);});
+                graph.precede(last, springs);
+                graph.precede(springs, tiles);
+            }
+            int seams = graph.add([this, tileGrain] {return (vertexBands() - 1) / tileGrain;}, 1, [this, tileGrain](int b, int e) {
+                for (int k = b; k < e; k++) gatherBand((k + 1) * tileGrain);
+            });
+            graph.precede(tiles, seams);
+            last = seams;
+
+            int finished = graph.add([this, colliders] {
+                finishStep(colliders ? *colliders : std::vector<Collider<T> >());
+            });
+            graph.precede(last, finished);
+            return finished;
+        }
 
-            for (int i = 0; i < vertices.size(); i++) {
-                positions[i] = vertices[i]->position;
-                normals[i] = vertices[i]->normal;
+        // Cut a frame into substeps of equal length and return how many.
+        // With a fixed step the frame is cut into the given number, or as
+        // few as the implicit step allows; adaptive cloths take as few as
+        // the step proposed by the last one allows.
+        int planFrame(T frame, int substeps) {
+            int count = substeps;
+            if (adaptive) {
+                count = std::max(1, (int)std::ceil(frame / proposedStep - T(1e-6)));
+            } else if (integrator == IMPLICIT || integrator == PROJECTIVE) {
+                count = std::max(1, (int)std::ceil(frame / implicitStep - T(1e-6)));
+            }
+            timestep = frame / count;
+            return count;
+        }
+
+        // Copy the simulated state into the vertex buffers, on the GL thread
+        void upload() {
+            for (size_t i = 0; i < vertices.size(); i++) {
+                positions[i] = glm::vec3(vertices.position[i]);
+                normals[i] = glm::vec3(vertices.normal[i]);
             }
 
             // Bind to the VAO.
             glBindVertexArray(VAO);
+            uploadVertices(positions, normals);
 
-            // Bind to the first VBO - We will use it to store the vertices
-            glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), positions.data(), GL_STATIC_DRAW);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+            // Send every index edited by tears since the last upload at once
+            if (topology != uploadedTopology) {
+                uploadIndices(indices, ClothFrame::edited(edits, uploadedTopology, topology, indices.size()));
+                uploadedTopology = topology;
+            }
+            indexCount = indices.size();
+            glBindVertexArray(0);
+        }
 
-            // Bind to the second VBO - We will use it to store the normals
-            glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_STATIC_DRAW);
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+        // Copy the render data into a frame, on the simulation thread. The
+        // vertices are only copied when they moved, and of the indices only
+        // those tears edited, since the frame was last filled.
+        void snapshot(ClothFrame& frame) {
+            if (frame.motion != motion) {
+                frame.positions.resize(vertices.size());
+                frame.normals.resize(vertices.size());
+                for (size_t i = 0; i < vertices.size(); i++) {
+                    frame.positions[i] = glm::vec3(vertices.position[i]);
+                    frame.normals[i] = glm::vec3(vertices.normal[i]);
+                }
+                frame.motion = motion;
+            }
+            if (frame.topology != topology) {
+                ClothFrame::Range r = ClothFrame::edited(edits, frame.topology, topology, indices.size());
+                frame.indices.resize(indices.size());
+                std::copy(indices.begin() + r.first, indices.begin() + std::max(r.first, r.second), frame.indices.begin() + r.first);
+                frame.edits = edits;
+                frame.topology = topology;
+            }
+            frame.solverFailures = projective.getFailures();
+        }
+
+        // Upload a frame taken by snapshot(), on the GL thread. A frame that
+        // carries new topology sends the indices edited since the version
+        // last uploaded, over all the frames skipped, in one call, and one
+        // whose cloth has not moved uploads nothing.
+        void upload(const ClothFrame& frame) {
+            glBindVertexArray(VAO);
+            if (frame.motion != uploadedMotion) {
+                uploadVertices(frame.positions, frame.normals);
+                uploadedMotion = frame.motion;
+            }
+
+            if (frame.topology != uploadedTopology) {
+                uploadIndices(frame.indices, ClothFrame::edited(frame.edits, uploadedTopology, frame.topology, frame.indices.size()));
+                uploadedTopology = frame.topology;
+                indexCount = frame.indices.size();
+            }
+            glBindVertexArray(0);
+        }
+
+        void setColor(glm::vec3 c) {color = c;}
+
+        void blowByWind(glm::vec3 wind)  {
+            vec3 w = vec3(glm::inverse(model) * glm::vec4(wind, 0));
+            if (w != pointWind) wakeAll();
+            pointWind = w;
+        }
+
+        // nullptr goes back to the uniform wind of blowByWind
+        void setWindField(const VelocityGrid<T>* field) {
+            windField = field;
+            windVersion = ~0ull;
+            airGrid = nullptr;
+            wakeAll();
+        }
+
+        // Blow with the air of the grid, and push back on it; nullptr
+        // uncouples and goes back to the uniform wind
+        void setAirGrid(AirGrid<T>* grid) {
+            setWindField(grid);
+            airGrid = grid;
+            std::fill(faceImpulses.begin(), faceImpulses.end(), vec3(0));
+        }
+
+        AirGrid<T>* getAirGrid() {return airGrid;}
+
+        // Add the impulses summed up since the last call to the air grid,
+        // at the face centroids. Runs between steps, never with them.
+        void injectAir() {
+            if (!airGrid) return;
+            glm::mat<4, 4, T, glm::defaultp> toWorld(model);
+            for (size_t t = 0; t < triangles.size(); t++) {
+                vec3 centroid = (vertices.position[indices[3 * t]] + vertices.position[indices[3 * t + 1]] + vertices.position[indices[3 * t + 2]]) / T(3);
+                vec3 p = vec3(toWorld * glm::vec<4, T, glm::defaultp>(centroid, 1));
+                vec3 impulse = vec3(toWorld * glm::vec<4, T, glm::defaultp>(faceImpulses[t], 0));
+                airGrid->addMomentum(p, impulse);
+                faceImpulses[t] = vec3(0);
+            }
         }
-        void blowByWind(glm::vec3 wind)  {pointWind = glm::vec3(glm::inverse(model) * glm::vec4(wind, 0));}
 
         void translate(glm::vec3 t) {
             translation += t;
-            glm::vec3 pointT = glm::vec3(glm::inverse(model) * glm::vec4(t, 0));
-            for (auto i : indexFixed) {
-                vertices[i]->position += pointT;
+            vec3 pointT = vec3(glm::inverse(model) * glm::vec4(t, 0));
+            for (auto& a : attachments) {
+                if (a.track >= 0) continue;
+                a.anchor += pointT;
+                vertices.position[a.vertex] += pointT;
+                if (a.vertex < (int)previousPositions.size()) previousPositions[a.vertex] += pointT;
+            }
+            wakeAll();
+            motion++;
+        }
+
+        // Stiffness scales the bending force by the position and damping
+        // by the velocity; both 0 leaves only the springs
+        void setBending(T stiffness, T damping) {
+            bendingStiffness = stiffness;
+            bendingDamping = damping;
+            wakeAll();
+        }
+
+        // Switch between the springs and the membrane model, which takes
+        // the material; the rest shape of both is the shape at construction
+        void setMembrane(bool enabled, const Membrane<T>& m = Membrane<T>()) {
+            membrane = enabled;
+            material = m;
+            wakeAll();
+        }
+        bool getMembrane() {return membrane;}
+
+        // Take implicit or projective substeps, which stay stable far
+        // beyond the longest explicit ones; without adaptive steps a frame
+        // is cut into substeps of at most step. Verlet substeps are as
+        // long as explicit ones.
+        void setIntegrator(Integrator i, T step = T(0.01)) {
+            if (integrator == VERLET && i != VERLET) {
+                for (size_t v = 0; v < vertices.size(); v++) vertices.velocity[v] = velocityOf(v);
+                previousPositions.clear();
+            } else if (integrator != VERLET && i == VERLET) {
+                lastStep = timestep;
+                previousPositions.resize(vertices.size());
+                for (size_t v = 0; v < vertices.size(); v++) {
+                    previousPositions[v] = vertices.position[v] - lastStep * vertices.velocity[v];
+                }
             }
+            integrator = i;
+            implicitStep = step;
+            wakeAll();
+        }
+        Integrator getIntegrator() {return integrator;}
+
+        // Rate, in 1/s, at which the air brings the vertices to its own
+        // velocity; setSleeping sets it too
+        void setAirDamping(T damping) {airDamping = damping;}
+        T getAirDamping() {return airDamping;}
+
+        // Fraction of the Verlet velocity lost every substep
+        void setVerletDamping(T damping) {verletDamping = damping;}
+        T getVerletDamping() {return verletDamping;}
+
+        // Iterations, residual and preconditioner of the implicit solves
+        ImplicitSolver<T>& getSolver() {return solver;}
+
+        // Iterations and acceleration of the projective solves
+        ProjectiveSolver<T>& getProjectiveSolver() {return projective;}
+
+        // The pool is not owned; nullptr runs the solver on the stepping thread
+        void setThreadPool(ThreadPool* p) {pool = p;}
+
+        // Let bands of vertices whose kinetic energy per unit mass, in J/kg,
+        // stays below energy for the given number of substeps sleep; energy
+        // <= 0 keeps every band awake. Sleeping also turns on the linear
+        // drag of the air, damping in 1/s, so that a cloth does settle.
+        void setSleeping(T energy, int steps = 100, T damping = T(1)) {
+            sleepEnergy = energy;
+            sleepSteps = steps;
+            airDamping = (energy > 0) ? damping : T(0);
+            wakeAll();
+        }
+
+        bool isAsleep() {
+            return sleepEnergy > 0 && std::find(sleeping.begin(), sleeping.end(), 0) == sleeping.end();
         }
 
+        // Stands in for the substeps of a frame while the whole cloth is
+        // asleep: wakes the faces whose wind changed, and keeps pushing on
+        // the air grid
+        void idle(T frame) {
+            const int lanes = FaceBatch<T>::lanes;
+            if (windField && windField->getVersion() != windVersion) {
+                FaceBatch<T> batch;
+                glm::mat<4, 4, T, glm::defaultp> toWorld(model);
+                glm::mat<4, 4, T, glm::defaultp> toModel(glm::inverse(model));
+                for (auto& band : triangleBands) {
+                    for (int f = 0; f < (int)band.size(); f += lanes) {
+                        const int* t = &band[f];
+                        int count = std::min(lanes, (int)band.size() - f);
+                        for (int l = 0; l < lanes; l++) {
+                            loadFace(batch, l, t[std::min(l, count - 1)], false);
+                        }
+                        sampleWind(batch, toWorld, toModel);
+                        checkWind(batch, t, count, wakeRequests);
+                    }
+                }
+                windVersion = windField->getVersion();
+                for (auto b : wakeRequests) {
+                    sleeping[b] = 0;
+                    stillSteps[b] = 0;
+                    windVersion = ~0ull;
+                }
+                wakeRequests.clear();
+            }
+            for (auto& band : triangleBands) {
+                addImpulses(band.data(), band.size(), frame);
+            }
+        }
+
+        // Size substeps by their error instead of cutting every frame into
+        // the same number; tolerance is the position error in m allowed in
+        // one substep
+        void setAdaptive(bool enabled, T tolerance = T(1e-4), T minStep = T(0.0002), T maxStep = T(0.004)) {
+            adaptive = enabled;
+            this->tolerance = tolerance;
+            this->minStep = minStep;
+            this->maxStep = maxStep;
+            proposedStep = std::min(maxStep, std::max(minStep, timestep));
+            stepLimit = maxStep;
+            resizeCheckpoint();
+        }
+        bool getAdaptive() {return adaptive;}
+
+        T getTimestep() {return timestep;}
+        unsigned long long getRejections() {return rejections;}
+
+        // Springs are moved back to between lower and upper times their
+        // rest length after every integration
+        void setStrainLimits(T lower, T upper) {
+            strainLower = lower;
+            strainUpper = upper;
+            wakeAll();
+        }
+
+        // strain <= 0 turns tearing off and restores the overstretch clamp
+        void setTearing(T strain) {
+            tearStrain = strain;
+            for (auto sd : springDampers) {
+                sd->setTearStrain(strain);
+            }
+            wakeAll();
+        }
+        T getTearing() {return tearStrain;}
+
+        // How often tears have had the vertices renumbered
+        unsigned long long getRenumberings() {return renumberings;}
+
+        // Sizes of the mesh, which tears change
+        size_t getVertexCount() {return vertices.size();}
+        size_t getSpringCount() {return springDampers.size();}
+        size_t getTriangleCount() {return triangles.size();}
+
+        // Let go of every pin, or take them all back where they were
         void toggleFree() {
-            for (auto i : indexFixed) {
-                vertices[i]->fixed = !vertices[i]->fixed;
+            released = !released;
+            for (auto& a : attachments) {
+                vertices.setFixed(a.vertex, !released);
             }
+            wakeAll();
+        }
+
+        // Pin a vertex where it is, or at a point in world space, either
+        // for good or to follow a track from there. Pinning a pinned
+        // vertex moves its pin. Vertices are named by id, row-major in the
+        // grid the cloth was built as, then in the order tears split them
+        // off; ids stay with their vertex when tears renumber the indices.
+        void pin(int id, int track = -1) {
+            attach(vertexIndices[id], track);
+            wakeAll();
+        }
+        void pinTo(int id, glm::vec3 world, int track = -1) {
+            int vertex = vertexIndices[id];
+            vertices.position[vertex] = vec3(glm::inverse(model) * glm::vec4(world, 1));
+            vertices.velocity[vertex] = vec3(0);
+            if (vertex < (int)previousPositions.size()) previousPositions[vertex] = vertices.position[vertex];
+            attach(vertex, track);
+            wakeAll();
         }
+        void unpin(int id) {
+            int vertex = vertexIndices[id];
+            for (size_t a = 0; a < attachments.size(); a++) {
+                if (attachments[a].vertex != vertex) continue;
+                attachments.erase(attachments.begin() + a);
+                vertices.setFixed(vertex, false);
+                break;
+            }
+            wakeAll();
+        }
+        bool isPinned(int id) {
+            int vertex = vertexIndices[id];
+            for (auto& a : attachments) {
+                if (a.vertex == vertex) return true;
+            }
+            return false;
+        }
+
+        // Where the vertex with the given id is, in world space
+        glm::vec3 getPosition(int id) {
+            return glm::vec3(model * glm::vec4(glm::vec3(vertices.position[vertexIndices[id]]), 1));
+        }
+
+        // A new track, in world space, for pins to follow; keys are in
+        // the time of getTime()
+        int addTrack() {
+            tracks.push_back(AttachmentTrack<T>());
+            return tracks.size() - 1;
+        }
+        AttachmentTrack<T>& getTrack(int track) {return tracks[track];}
+
+        T getTime() {return clock;}
 };
-#endif
\ No newline at end of file
+// Instantiated once in Physics.cpp
+extern template class Cloth<float>;
+extern template class Cloth<double>;
+#endif
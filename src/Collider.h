@@ -0,0 +1,74 @@
+#ifndef _COLLIDER_H_
+#define _COLLIDER_H_
+
+#include "utils.h"
+
+// Static obstacle the cloth vertices are pushed out of: either a plane
+// (point and normal) or a sphere (center and radius).
+template <typename T>
+class Collider {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+        typedef glm::vec<4, T, glm::defaultp> vec4;
+        typedef glm::mat<4, 4, T, glm::defaultp> mat4;
+        enum Shape { PLANE, SPHERE };
+
+    private:
+        Shape shape;
+        vec3 point;
+        vec3 normal;
+        T radius;
+        T friction;     // Fraction of the tangential velocity lost on contact
+
+    public:
+        Collider(Shape s, vec3 p, vec3 n, T r) {
+            shape = s;
+            point = p;
+            normal = (shape == PLANE) ? glm::normalize(n) : n;
+            radius = r;
+            friction = T(0.3);
+        }
+
+        static Collider plane(vec3 p, vec3 n) {return Collider(PLANE, p, n, 0);}
+        static Collider sphere(vec3 center, T r) {return Collider(SPHERE, center, vec3(0), r);}
+
+        void setFriction(T f) {friction = f;}
+
+        // The same collider expressed in another space, e.g. a cloth's model space
+        Collider transformed(const mat4& m) const {
+            Collider c = *this;
+            c.point = vec3(m * vec4(point, T(1)));
+            if (shape == PLANE) {
+                c.normal = glm::normalize(vec3(glm::transpose(glm::inverse(m)) * vec4(normal, T(0))));
+            }
+            return c;
+        }
+
+        void resolve(vec3& position, vec3& velocity) const {
+            vec3 n;
+            T depth;
+            if (shape == PLANE) {
+                n = normal;
+                depth = -glm::dot(position - point, normal);
+            }
+            else {
+                vec3 d = position - point;
+                T distance = glm::length(d);
+                n = (distance != 0) ? d / distance : vec3(0, 1, 0);
+                depth = radius - distance;
+            }
+            if (depth <= 0) return;
+
+            position += depth * n;
+            T vn = glm::dot(velocity, n);
+            if (vn < 0) {
+                vec3 tangent = velocity - vn * n;
+                velocity = (1 - friction) * tangent;
+            }
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class Collider<float>;
+extern template class Collider<double>;
+#endif
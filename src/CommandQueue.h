@@ -0,0 +1,36 @@
+#ifndef _COMMAND_QUEUE_H_
+#define _COMMAND_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue for one producer thread and one consumer thread
+template <typename C, size_t N>
+class CommandQueue {
+    private:
+        C slots[N];
+        std::atomic<size_t> head;   // next slot to pop, advanced by the consumer
+        std::atomic<size_t> tail;   // next slot to push, advanced by the producer
+
+    public:
+        CommandQueue() : head(0), tail(0) {}
+
+        // Returns false, dropping the command, when the queue is full
+        bool push(const C& command) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t next = (t + 1) % N;
+            if (next == head.load(std::memory_order_acquire)) return false;
+            slots[t] = command;
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(C& command) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return false;
+            command = slots[h];
+            head.store((h + 1) % N, std::memory_order_release);
+            return true;
+        }
+};
+#endif
@@ -0,0 +1,352 @@
+#ifndef _IMPLICIT_SOLVER_H_
+#define _IMPLICIT_SOLVER_H_
+
+#include "BlockMatrix.h"
+#include "Multigrid.h"
+#include "IncompleteCholesky.h"
+#include "Chebyshev.h"
+
+#include <cmath>
+#include <vector>
+
+// Solver for the linear system of an implicit step, A dv = b with A
+// symmetric and definite: conjugate gradients preconditioned by block
+// Jacobi, incomplete Cholesky or multigrid, or block Jacobi iterations with
+// Chebyshev acceleration, which need no dot products across the whole
+// system but more iterations. The Jacobi diagonal takes
+// the l1 form (Baker et al. 2011), every block plus the norms of the other
+// blocks of its row, which converges for any such A; the bending and
+// membrane stencils reach over three and four vertices and make plain
+// Jacobi diverge once they are stiff. The owner fills the matrix,
+// the right-hand side and the constrained rows, which must hold only the
+// identity and a zero right-hand side. Sums are taken per chunk of fixed
+// size and then in order, so the result does not depend on how many
+// threads ran the kernels.
+template <typename T>
+class ImplicitSolver {
+    public:
+        typedef typename BlockMatrix<T>::vec3 vec3;
+        typedef typename BlockMatrix<T>::mat3 mat3;
+
+        enum Method {CONJUGATE_GRADIENT, JACOBI};
+        enum Preconditioner {NONE, BLOCK_JACOBI, INCOMPLETE_CHOLESKY, MULTIGRID};
+
+        // Totals over the solves since the last reset
+        struct Statistics {
+            long solves;
+            long iterations;
+            int mostIterations;
+            T worstResidual;
+        };
+
+    private:
+        static const int grain = 512;
+
+        BlockMatrix<T> matrix;
+        std::vector<vec3> rhs;
+        std::vector<vec3> solution;
+        std::vector<char> constrained;
+        std::vector<vec3> residual;
+        std::vector<vec3> direction;
+        std::vector<vec3> product;
+        std::vector<vec3> preconditioned;
+        std::vector<T> partials;
+
+        Method method;
+        Chebyshev<T> chebyshev;
+        std::vector<mat3> inverseDiagonal;
+        std::vector<vec3> older;    // the Jacobi iterate before the last
+
+        Preconditioner preconditioner;
+        std::vector<mat3> inverseBlocks;    // of block Jacobi
+        IncompleteCholesky<T> incomplete;
+        Multigrid<T> multigrid;
+        std::vector<int> cells;
+        int gridRows, gridColumns;
+        bool gridChanged;
+
+        bool warmStart;
+        T tolerance;        // on the residual, relative to the right-hand side
+        int maxIterations;
+        int iterations;     // taken by the last solve
+        T error;            // and its relative residual
+        Statistics statistics;
+        ThreadPool* pool;   // of the solve running
+
+        template <typename F>
+        T sum(int count, const F& f) {
+            int chunks = (count + grain - 1) / grain;
+            partials.assign(chunks, T(0));
+            BlockMatrix<T>::forRange(pool, chunks, 1, [&](int b, int e) {
+                for (int c = b; c < e; c++) {
+                    partials[c] = f(c * grain, std::min(count, (c + 1) * grain));
+                }
+            });
+            T total = 0;
+            for (auto p : partials) total += p;
+            return total;
+        }
+
+        T dot(const std::vector<vec3>& a, const std::vector<vec3>& b) {
+            return sum(a.size(), [&](int begin, int end) {
+                T s = 0;
+                for (int i = begin; i < end; i++) s += glm::dot(a[i], b[i]);
+                return s;
+            });
+        }
+
+        // One Jacobi iteration from solution into product, weighted by the
+        // Chebyshev stage, with the squared norms of the residual before it
+        // and of the change in partials
+        void relax(int chunk, int begin, int end) {
+            T omega = chebyshev.weight();
+            T rr = 0, change = 0;
+            for (int i = begin; i < end; i++) {
+                vec3 r = rhs[i];
+                for (int k = matrix.starts[i]; k < matrix.starts[i + 1]; k++) {
+                    r -= matrix.blocks[k] * solution[matrix.columns[k]];
+                }
+                vec3 y = solution[i] + inverseDiagonal[i] * r;
+                y = omega * (y - older[i]) + older[i];
+                product[i] = y;
+                rr += glm::dot(r, r);
+                change += glm::dot(y - solution[i], y - solution[i]);
+            }
+            partials[2 * chunk] = rr;
+            partials[2 * chunk + 1] = change;
+        }
+
+        void solveJacobi(T limit, T& rr) {
+            int n = matrix.rows();
+            int chunks = (n + grain - 1) / grain;
+            inverseDiagonal.resize(n);
+            older = solution;
+            BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                for (int i = b; i < e; i++) {
+                    T offDiagonal = 0;
+                    for (int k = matrix.starts[i]; k < matrix.starts[i + 1]; k++) {
+                        if (k == matrix.diagonals[i]) continue;
+                        const mat3& a = matrix.blocks[k];
+                        offDiagonal += std::sqrt(glm::dot(a[0], a[0]) + glm::dot(a[1], a[1]) + glm::dot(a[2], a[2]));
+                    }
+                    inverseDiagonal[i] = glm::inverse(matrix.blocks[matrix.diagonals[i]] + offDiagonal * mat3(T(1)));
+                }
+            });
+
+            chebyshev.start();
+            while (iterations < maxIterations) {
+                partials.assign(2 * chunks, T(0));
+                BlockMatrix<T>::forRange(pool, chunks, 1, [&](int b, int e) {
+                    for (int c = b; c < e; c++) relax(c, c * grain, std::min(n, (c + 1) * grain));
+                });
+                rr = 0;
+                T change = 0;
+                for (int c = 0; c < chunks; c++) {
+                    rr += partials[2 * c];
+                    change += partials[2 * c + 1];
+                }
+                if (rr <= limit) break;
+                older.swap(solution);
+                solution.swap(product);
+                iterations++;
+                chebyshev.next(change);
+            }
+        }
+
+        // Start from the solution in place, with the constrained rows
+        // zeroed, and return the squared norm of its residual
+        T start() {
+            BlockMatrix<T>::forRange(pool, matrix.rows(), grain, [&](int b, int e) {
+                for (int i = b; i < e; i++) {
+                    if (constrained[i]) solution[i] = vec3(0);
+                }
+            });
+            return sum(matrix.rows(), [&](int begin, int end) {
+                matrix.multiply(solution, residual, begin, end);
+                T s = 0;
+                for (int i = begin; i < end; i++) {
+                    residual[i] = rhs[i] - residual[i];
+                    s += glm::dot(residual[i], residual[i]);
+                }
+                return s;
+            });
+        }
+
+        void precondition() {
+            if (preconditioner == MULTIGRID) {
+                multigrid.apply(residual, preconditioned, pool);
+            } else if (preconditioner == INCOMPLETE_CHOLESKY) {
+                incomplete.apply(residual, preconditioned);
+            } else if (preconditioner == BLOCK_JACOBI) {
+                BlockMatrix<T>::forRange(pool, matrix.rows(), grain, [&](int b, int e) {
+                    for (int i = b; i < e; i++) preconditioned[i] = inverseBlocks[i] * residual[i];
+                });
+            } else {
+                preconditioned = residual;
+            }
+        }
+
+        void run() {
+            int n = matrix.rows();
+            iterations = 0;
+            error = 0;
+            T bb = dot(rhs, rhs);
+            if (bb == 0) {
+                std::fill(solution.begin(), solution.end(), vec3(0));
+                return;
+            }
+            T limit = tolerance * tolerance * bb;
+            T rr = warmStart ? start() : bb;
+            if (rr >= bb) {
+                // no better than nothing
+                std::fill(solution.begin(), solution.end(), vec3(0));
+                residual = rhs;
+                rr = bb;
+            }
+
+            if (method == JACOBI) {
+                solveJacobi(limit, rr);
+                error = std::sqrt(rr / bb);
+                return;
+            }
+
+            if (preconditioner == MULTIGRID) {
+                if (gridChanged || multigrid.stale(matrix)) {
+                    multigrid.setup(matrix, cells, gridRows, gridColumns);
+                    gridChanged = false;
+                }
+                multigrid.update(constrained, pool);
+            } else if (preconditioner == INCOMPLETE_CHOLESKY) {
+                incomplete.compute(matrix);
+            } else if (preconditioner == BLOCK_JACOBI) {
+                inverseBlocks.resize(n);
+                BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                    for (int i = b; i < e; i++) inverseBlocks[i] = glm::inverse(matrix.blocks[matrix.diagonals[i]]);
+                });
+            }
+            precondition();
+            direction = preconditioned;
+            T rz = dot(residual, preconditioned);
+
+            while (iterations < maxIterations && rr > limit) {
+                BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {matrix.multiply(direction, product, b, e);});
+                T pAp = dot(direction, product);
+                if (!(pAp > 0)) break;
+                T alpha = rz / pAp;
+                rr = sum(n, [&](int begin, int end) {
+                    T s = 0;
+                    for (int i = begin; i < end; i++) {
+                        solution[i] += alpha * direction[i];
+                        residual[i] -= alpha * product[i];
+                        s += glm::dot(residual[i], residual[i]);
+                    }
+                    return s;
+                });
+                iterations++;
+                if (rr <= limit) break;
+
+                precondition();
+                T next = dot(residual, preconditioned);
+                T beta = next / rz;
+                rz = next;
+                BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                    for (int i = b; i < e; i++) direction[i] = preconditioned[i] + beta * direction[i];
+                });
+            }
+            error = std::sqrt(rr / bb);
+        }
+
+    public:
+        ImplicitSolver() {
+            method = CONJUGATE_GRADIENT;
+            preconditioner = MULTIGRID;
+            gridRows = gridColumns = 0;
+            gridChanged = true;
+            warmStart = true;
+            tolerance = T(1e-3);
+            maxIterations = 100;
+            iterations = 0;
+            error = 0;
+            pool = nullptr;
+            resetStatistics();
+        }
+
+        BlockMatrix<T>& getMatrix() {return matrix;}
+        std::vector<vec3>& getRhs() {return rhs;}
+        std::vector<vec3>& getSolution() {return solution;}
+        std::vector<char>& getConstrained() {return constrained;}
+
+        // Size the vectors for the rows of the matrix's pattern. The
+        // solution keeps the rows it had, for a warm start, and new rows
+        // start from 0.
+        void resize() {
+            int n = matrix.rows();
+            rhs.resize(n);
+            solution.resize(n, vec3(0));
+            constrained.resize(n, 0);
+            residual.resize(n);
+            direction.resize(n);
+            product.resize(n);
+            preconditioned.resize(n);
+        }
+
+        // Node i of the matrix lies on cell cells[i] of a grid of rows by
+        // columns, for the multigrid preconditioner
+        void setGrid(const std::vector<int>& cells, int rows, int columns) {
+            this->cells = cells;
+            gridRows = rows;
+            gridColumns = columns;
+            gridChanged = true;
+        }
+
+        void setMethod(Method m) {method = m;}
+        Method getMethod() const {return method;}
+
+        // The acceleration of the Jacobi iterations, and its estimate of
+        // their spectral radius
+        Chebyshev<T>& getChebyshev() {return chebyshev;}
+
+        // Of conjugate gradients only. Block Jacobi inverts the diagonal
+        // blocks; incomplete Cholesky takes far fewer iterations but runs
+        // serially; multigrid takes fewest and scales best.
+        void setPreconditioner(Preconditioner p) {preconditioner = p;}
+        Preconditioner getPreconditioner() const {return preconditioner;}
+
+        // Start every solve from the last solution, after the owner has
+        // mended the rows it renumbered, rather than from 0
+        void setWarmStart(bool enabled) {warmStart = enabled;}
+        bool getWarmStart() const {return warmStart;}
+
+        void setTolerance(T relative, int iterations) {
+            tolerance = relative;
+            maxIterations = iterations;
+        }
+
+        int getIterations() const {return iterations;}
+        T getResidual() const {return error;}
+        int getLevels() const {return multigrid.getLevels();}
+
+        const Statistics& getStatistics() const {return statistics;}
+        void resetStatistics() {
+            statistics.solves = statistics.iterations = 0;
+            statistics.mostIterations = 0;
+            statistics.worstResidual = 0;
+        }
+
+        // Solve from the last solution or from 0; the pool, if any, runs
+        // the kernels. Returns the iterations taken.
+        int solve(ThreadPool* p) {
+            pool = p;
+            run();
+            statistics.solves++;
+            statistics.iterations += iterations;
+            statistics.mostIterations = std::max(statistics.mostIterations, iterations);
+            statistics.worstResidual = std::max(statistics.worstResidual, error);
+            return iterations;
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class ImplicitSolver<float>;
+extern template class ImplicitSolver<double>;
+#endif
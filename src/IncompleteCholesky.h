@@ -0,0 +1,110 @@
+#ifndef _INCOMPLETE_CHOLESKY_H_
+#define _INCOMPLETE_CHOLESKY_H_
+
+#include "BlockMatrix.h"
+
+#include <vector>
+
+// Incomplete Cholesky factorization without fill, IC(0), of a symmetric
+// definite block matrix, in the form (D + L) D^-1 (D + L^T) with L strictly
+// lower and D block diagonal, both on the pattern of the matrix. Dropping
+// the fill can leave a block of D indefinite; the factorization then starts
+// over with the diagonal scaled up a little more each time (Manteuffel
+// 1980). Both triangular solves are serial, so it suits smaller systems
+// better than the multigrid preconditioner, but it takes far fewer
+// iterations than block Jacobi.
+template <typename T>
+class IncompleteCholesky {
+    public:
+        typedef typename BlockMatrix<T>::vec3 vec3;
+        typedef typename BlockMatrix<T>::mat3 mat3;
+
+    private:
+        std::vector<mat3> lower;        // L on the pattern of the matrix, 0 elsewhere
+        std::vector<mat3> inverses;     // of the blocks of D
+        std::vector<vec3> pending;      // of the backward solve
+        const BlockMatrix<T>* matrix;
+        T shift;                        // of the last factorization
+
+        static bool definite(const mat3& a) {
+            T m1 = a[0][0];
+            T m2 = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+            return m1 > 0 && m2 > 0 && glm::determinant(a) > 0;
+        }
+
+        bool factor(T scale) {
+            const BlockMatrix<T>& A = *matrix;
+            int n = A.rows();
+            for (int i = 0; i < n; i++) {
+                for (int k = A.starts[i]; k < A.diagonals[i]; k++) {
+                    int j = A.columns[k];
+                    // subtract L_im D_m^-1 L_jm^T over the columns m < j of both rows
+                    mat3 s = A.blocks[k];
+                    int a = A.starts[i], b = A.starts[j];
+                    while (a < k && b < A.diagonals[j]) {
+                        if (A.columns[a] < A.columns[b]) {
+                            a++;
+                        } else if (A.columns[a] > A.columns[b]) {
+                            b++;
+                        } else {
+                            s -= lower[a] * inverses[A.columns[a]] * glm::transpose(lower[b]);
+                            a++;
+                            b++;
+                        }
+                    }
+                    lower[k] = s;
+                }
+                mat3 d = scale * A.blocks[A.diagonals[i]];
+                for (int k = A.starts[i]; k < A.diagonals[i]; k++) {
+                    d -= lower[k] * inverses[A.columns[k]] * glm::transpose(lower[k]);
+                }
+                if (!definite(d)) return false;
+                inverses[i] = glm::inverse(d);
+            }
+            return true;
+        }
+
+    public:
+        IncompleteCholesky() : matrix(nullptr), shift(0) {}
+
+        // Factor the current values of A, which must outlive the factor
+        void compute(const BlockMatrix<T>& A) {
+            matrix = &A;
+            lower.resize(A.blocks.size());
+            inverses.resize(A.rows());
+            pending.resize(A.rows());
+            shift = 0;
+            while (!factor(T(1) + shift)) {
+                shift = (shift == 0) ? T(1e-3) : T(2) * shift;
+            }
+        }
+
+        // z = ((D + L) D^-1 (D + L^T))^-1 r
+        void apply(const std::vector<vec3>& r, std::vector<vec3>& z) {
+            const BlockMatrix<T>& A = *matrix;
+            int n = A.rows();
+            for (int i = 0; i < n; i++) {
+                vec3 s = r[i];
+                for (int k = A.starts[i]; k < A.diagonals[i]; k++) {
+                    s -= lower[k] * z[A.columns[k]];
+                }
+                z[i] = inverses[i] * s;
+            }
+            // by columns of L^T, that is by rows of L
+            std::fill(pending.begin(), pending.end(), vec3(0));
+            for (int i = n - 1; i >= 0; i--) {
+                z[i] -= inverses[i] * pending[i];
+                for (int k = A.starts[i]; k < A.diagonals[i]; k++) {
+                    pending[A.columns[k]] += glm::transpose(lower[k]) * z[i];
+                }
+            }
+        }
+
+        // The diagonal scaling the last factorization needed, 0 if none
+        T getShift() const {return shift;}
+};
+
+// Instantiated once in Physics.cpp
+extern template class IncompleteCholesky<float>;
+extern template class IncompleteCholesky<double>;
+#endif
@@ -0,0 +1,395 @@
+#ifndef _MULTIGRID_H_
+#define _MULTIGRID_H_
+
+#include "BlockMatrix.h"
+
+#include <cmath>
+#include <vector>
+
+// Geometric multigrid over the grid of rows and columns a cloth was built
+// from. Each level keeps every other row and column of the one below, and
+// a node below takes the bilinear interpolation P of the up to four nodes
+// around it; vertices split off by tears sit where they were split from.
+// Coarse operators are the Galerkin product P^T (A P), so they stay
+// symmetric and definite without knowing any forces. A V-cycle smooths
+// with damped block Jacobi on the way down and up and solves the coarsest
+// level with a dense Cholesky factorization, which makes it a symmetric
+// preconditioner whose effect per cycle does not depend on the grid size.
+template <typename T>
+class Multigrid {
+    public:
+        typedef typename BlockMatrix<T>::vec3 vec3;
+        typedef typename BlockMatrix<T>::mat3 mat3;
+
+    private:
+        struct Level {
+            const BlockMatrix<T>* matrix;   // the finest is not owned
+            BlockMatrix<T> coarse;
+            // interpolation from the next level up, by node of this one
+            std::vector<int> parentStarts;
+            std::vector<int> parents;
+            std::vector<T> gridWeights;
+            std::vector<T> weights;         // gridWeights without the constrained nodes
+            std::vector<int> owners;        // node of each interpolation entry
+            // the entries that interpolate from each node of this level
+            std::vector<int> childStarts;
+            std::vector<int> children;
+            BlockMatrix<T> interpolated;    // A P, by node of this level and of the next
+            std::vector<mat3> inverseDiagonal;
+            std::vector<vec3> x, b, next;
+
+            int nodes() const {return matrix->rows();}
+        };
+
+        static const int grain = 256;
+        std::vector<Level*> levels;
+        int sweeps;         // of the smoother, before and after the coarse correction
+        T omega;            // Jacobi damping
+        int coarsest;       // most nodes of the level solved directly
+        unsigned long long fineVersion;
+        std::vector<T> dense;   // Cholesky factor of the coarsest level, by rows
+
+        // Interpolation along one axis from a grid of half the nodes
+        static int axisWeights(int x, int coarseCount, int parent[2], T weight[2]) {
+            if (x % 2 == 0) {
+                parent[0] = x / 2;
+                weight[0] = 1;
+                return 1;
+            }
+            parent[0] = x / 2;
+            parent[1] = x / 2 + 1;
+            if (parent[1] >= coarseCount) {
+                weight[0] = 1;
+                return 1;
+            }
+            weight[0] = weight[1] = T(0.5);
+            return 2;
+        }
+
+        void clearLevels() {
+            for (auto l : levels) {
+                delete l;
+            }
+            levels.clear();
+        }
+
+        // Link level l to a new level above it on a grid of the given size,
+        // whose pattern is that of P^T (A P)
+        void coarsen(int l, const std::vector<int>& cells, int fineColumns, int rows, int columns) {
+            Level& fine = *levels[l];
+            Level* coarse = new Level();
+            levels.push_back(coarse);
+            coarse->matrix = &coarse->coarse;
+            int count = rows * columns;
+
+            fine.parentStarts.assign(1, 0);
+            fine.parents.clear();
+            fine.gridWeights.clear();
+            fine.owners.clear();
+            for (int i = 0; i < fine.nodes(); i++) {
+                int cell = cells.empty() ? i : cells[i];
+                int rowParents[2], columnParents[2];
+                T rowWeights[2], columnWeights[2];
+                int nr = axisWeights(cell / fineColumns, rows, rowParents, rowWeights);
+                int nc = axisWeights(cell % fineColumns, columns, columnParents, columnWeights);
+                for (int a = 0; a < nr; a++) {
+                    for (int c = 0; c < nc; c++) {
+                        fine.parents.push_back(rowParents[a] * columns + columnParents[c]);
+                        fine.gridWeights.push_back(rowWeights[a] * columnWeights[c]);
+                        fine.owners.push_back(i);
+                    }
+                }
+                fine.parentStarts.push_back(fine.parents.size());
+            }
+            fine.weights = fine.gridWeights;
+
+            coarse->childStarts.assign(count + 1, 0);
+            for (auto p : fine.parents) {
+                coarse->childStarts[p + 1]++;
+            }
+            for (int I = 0; I < count; I++) {
+                coarse->childStarts[I + 1] += coarse->childStarts[I];
+            }
+            coarse->children.resize(fine.parents.size());
+            std::vector<int> fill(coarse->childStarts.begin(), coarse->childStarts.end() - 1);
+            for (size_t k = 0; k < fine.parents.size(); k++) {
+                coarse->children[fill[fine.parents[k]]++] = k;
+            }
+
+            const BlockMatrix<T>& A = *fine.matrix;
+            std::vector<std::pair<int, int> > pairs;
+            std::vector<int> mark(count, -1);
+            for (int i = 0; i < fine.nodes(); i++) {
+                for (int s = A.starts[i]; s < A.starts[i + 1]; s++) {
+                    int j = A.columns[s];
+                    for (int m = fine.parentStarts[j]; m < fine.parentStarts[j + 1]; m++) {
+                        if (mark[fine.parents[m]] == i) continue;
+                        mark[fine.parents[m]] = i;
+                        pairs.push_back(std::make_pair(i, fine.parents[m]));
+                    }
+                }
+            }
+            fine.interpolated.setPattern(fine.nodes(), pairs, false);
+
+            const BlockMatrix<T>& B = fine.interpolated;
+            pairs.clear();
+            std::fill(mark.begin(), mark.end(), -1);
+            for (int I = 0; I < count; I++) {
+                for (int c = coarse->childStarts[I]; c < coarse->childStarts[I + 1]; c++) {
+                    int i = fine.owners[coarse->children[c]];
+                    for (int k = B.starts[i]; k < B.starts[i + 1]; k++) {
+                        if (mark[B.columns[k]] == I) continue;
+                        mark[B.columns[k]] = I;
+                        pairs.push_back(std::make_pair(I, B.columns[k]));
+                    }
+                }
+            }
+            coarse->coarse.setPattern(count, pairs);
+        }
+
+        // A P of level l, by its rows
+        void interpolate(int l, int begin, int end) {
+            Level& fine = *levels[l];
+            const BlockMatrix<T>& A = *fine.matrix;
+            BlockMatrix<T>& B = fine.interpolated;
+            for (int i = begin; i < end; i++) {
+                for (int k = B.starts[i]; k < B.starts[i + 1]; k++) {
+                    B.blocks[k] = mat3(T(0));
+                }
+                for (int s = A.starts[i]; s < A.starts[i + 1]; s++) {
+                    int j = A.columns[s];
+                    for (int m = fine.parentStarts[j]; m < fine.parentStarts[j + 1]; m++) {
+                        if (fine.weights[m] != 0) B.blocks[B.find(i, fine.parents[m])] += fine.weights[m] * A.blocks[s];
+                    }
+                }
+            }
+        }
+
+        // Values of level l + 1 from A P of level l, by coarse rows
+        void galerkin(int l, int begin, int end) {
+            const Level& fine = *levels[l];
+            Level& coarse = *levels[l + 1];
+            const BlockMatrix<T>& B = fine.interpolated;
+            BlockMatrix<T>& C = coarse.coarse;
+            for (int I = begin; I < end; I++) {
+                for (int k = C.starts[I]; k < C.starts[I + 1]; k++) {
+                    C.blocks[k] = mat3(T(0));
+                }
+                for (int c = coarse.childStarts[I]; c < coarse.childStarts[I + 1]; c++) {
+                    int entry = coarse.children[c];
+                    T w = fine.weights[entry];
+                    if (w == 0) continue;
+                    int i = fine.owners[entry];
+                    for (int k = B.starts[i]; k < B.starts[i + 1]; k++) {
+                        C.blocks[C.find(I, B.columns[k])] += w * B.blocks[k];
+                    }
+                }
+            }
+        }
+
+        void invertDiagonal(Level& level, int begin, int end) {
+            const BlockMatrix<T>& A = *level.matrix;
+            for (int i = begin; i < end; i++) {
+                const mat3& d = A.blocks[A.diagonals[i]];
+                // nodes whose children are all constrained have nothing left
+                level.inverseDiagonal[i] = (glm::determinant(d) > 0) ? glm::inverse(d) : mat3(T(0));
+            }
+        }
+
+        void factorCoarsest() {
+            const BlockMatrix<T>& A = *levels.back()->matrix;
+            int n = 3 * A.rows();
+            dense.assign(n * n, T(0));
+            for (int i = 0; i < A.rows(); i++) {
+                for (int k = A.starts[i]; k < A.starts[i + 1]; k++) {
+                    for (int a = 0; a < 3; a++) {
+                        for (int b = 0; b < 3; b++) {
+                            dense[(3 * i + a) * n + 3 * A.columns[k] + b] = A.blocks[k][b][a];
+                        }
+                    }
+                }
+            }
+
+            // lower triangle in place; empty rows get a unit pivot
+            for (int j = 0; j < n; j++) {
+                T d = dense[j * n + j];
+                for (int k = 0; k < j; k++) {
+                    d -= dense[j * n + k] * dense[j * n + k];
+                }
+                d = (d > T(1e-12) * std::abs(dense[j * n + j]) && d > 0) ? std::sqrt(d) : T(1);
+                dense[j * n + j] = d;
+                for (int i = j + 1; i < n; i++) {
+                    T s = dense[i * n + j];
+                    for (int k = 0; k < j; k++) {
+                        s -= dense[i * n + k] * dense[j * n + k];
+                    }
+                    dense[i * n + j] = s / d;
+                }
+            }
+        }
+
+        void solveCoarsest() {
+            Level& level = *levels.back();
+            int n = 3 * level.nodes();
+            T* x = &level.x[0].x;
+            const T* b = &level.b[0].x;
+            for (int i = 0; i < n; i++) {
+                T s = b[i];
+                for (int k = 0; k < i; k++) {
+                    s -= dense[i * n + k] * x[k];
+                }
+                x[i] = s / dense[i * n + i];
+            }
+            for (int i = n - 1; i >= 0; i--) {
+                T s = x[i];
+                for (int k = i + 1; k < n; k++) {
+                    s -= dense[k * n + i] * x[k];
+                }
+                x[i] = s / dense[i * n + i];
+            }
+        }
+
+        // One damped Jacobi sweep, x += omega D^-1 (b - A x), by rows
+        void smooth(Level& level, int begin, int end) {
+            const BlockMatrix<T>& A = *level.matrix;
+            for (int i = begin; i < end; i++) {
+                vec3 r = level.b[i];
+                for (int k = A.starts[i]; k < A.starts[i + 1]; k++) {
+                    r -= A.blocks[k] * level.x[A.columns[k]];
+                }
+                level.next[i] = level.x[i] + omega * (level.inverseDiagonal[i] * r);
+            }
+        }
+
+        // The residual of level l, restricted onto level l + 1 by P^T
+        void restrictResidual(int l, int begin, int end) {
+            Level& fine = *levels[l];
+            Level& coarse = *levels[l + 1];
+            const BlockMatrix<T>& A = *fine.matrix;
+            for (int I = begin; I < end; I++) {
+                vec3 sum(0);
+                for (int c = coarse.childStarts[I]; c < coarse.childStarts[I + 1]; c++) {
+                    int entry = coarse.children[c];
+                    if (fine.weights[entry] == 0) continue;
+                    int i = fine.owners[entry];
+                    vec3 r = fine.b[i];
+                    for (int k = A.starts[i]; k < A.starts[i + 1]; k++) {
+                        r -= A.blocks[k] * fine.x[A.columns[k]];
+                    }
+                    sum += fine.weights[entry] * r;
+                }
+                coarse.b[I] = sum;
+            }
+        }
+
+        void prolong(int l, int begin, int end) {
+            Level& fine = *levels[l];
+            const Level& coarse = *levels[l + 1];
+            for (int i = begin; i < end; i++) {
+                vec3 sum(0);
+                for (int m = fine.parentStarts[i]; m < fine.parentStarts[i + 1]; m++) {
+                    sum += fine.weights[m] * coarse.x[fine.parents[m]];
+                }
+                fine.x[i] += sum;
+            }
+        }
+
+        void cycle(int l, ThreadPool* pool) {
+            Level& level = *levels[l];
+            if (l == (int)levels.size() - 1) {
+                solveCoarsest();
+                return;
+            }
+            int n = level.nodes();
+            auto relax = [&] {
+                BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {smooth(level, b, e);});
+                level.x.swap(level.next);
+            };
+            // the first sweep starts from zero
+            BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                for (int i = b; i < e; i++) level.x[i] = omega * (level.inverseDiagonal[i] * level.b[i]);
+            });
+            for (int s = 1; s < sweeps; s++) relax();
+            BlockMatrix<T>::forRange(pool, levels[l + 1]->nodes(), grain, [&](int b, int e) {restrictResidual(l, b, e);});
+            cycle(l + 1, pool);
+            BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {prolong(l, b, e);});
+            for (int s = 0; s < sweeps; s++) relax();
+        }
+
+    public:
+        Multigrid() : sweeps(2), omega(T(0.6)), coarsest(64), fineVersion(~0ull) {}
+
+        ~Multigrid() {clearLevels();}
+
+        Multigrid(const Multigrid&) = delete;
+        Multigrid& operator=(const Multigrid&) = delete;
+
+        void setSmoothing(int count, T damping) {
+            sweeps = count;
+            omega = damping;
+        }
+
+        int getLevels() const {return levels.size();}
+
+        // Build the levels over a matrix whose node i lies on grid cell
+        // cells[i] of a grid of rows by columns, or on cell i if cells is
+        // empty. Only needed when the pattern of the matrix changes.
+        void setup(const BlockMatrix<T>& fine, const std::vector<int>& cells, int rows, int columns) {
+            clearLevels();
+            levels.push_back(new Level());
+            levels[0]->matrix = &fine;
+            const std::vector<int>* grid = &cells;
+            std::vector<int> none;
+            while (levels.back()->nodes() > coarsest && (rows > 2 || columns > 2)) {
+                int coarseRows = (rows + 1) / 2, coarseColumns = (columns + 1) / 2;
+                coarsen(levels.size() - 1, *grid, columns, coarseRows, coarseColumns);
+                grid = &none;
+                rows = coarseRows;
+                columns = coarseColumns;
+            }
+            for (auto l : levels) {
+                l->inverseDiagonal.resize(l->nodes());
+                l->x.resize(l->nodes());
+                l->b.resize(l->nodes());
+                l->next.resize(l->nodes());
+            }
+            fineVersion = fine.version;
+        }
+
+        // Whether setup has to run again for the matrix
+        bool stale(const BlockMatrix<T>& fine) const {
+            return levels.empty() || levels[0]->matrix != &fine || fine.version != fineVersion;
+        }
+
+        // Refresh the coarse operators after the values of the finest
+        // changed. Constrained nodes, whose rows only hold the identity,
+        // neither pass on nor take any correction.
+        void update(const std::vector<char>& constrained, ThreadPool* pool) {
+            Level& first = *levels[0];
+            for (size_t k = 0; k < first.weights.size(); k++) {
+                first.weights[k] = constrained[first.owners[k]] ? T(0) : first.gridWeights[k];
+            }
+            for (size_t l = 0; l + 1 < levels.size(); l++) {
+                BlockMatrix<T>::forRange(pool, levels[l]->nodes(), grain, [&](int b, int e) {interpolate(l, b, e);});
+                BlockMatrix<T>::forRange(pool, levels[l + 1]->nodes(), grain, [&](int b, int e) {galerkin(l, b, e);});
+            }
+            for (size_t l = 0; l + 1 < levels.size(); l++) {
+                Level& level = *levels[l];
+                BlockMatrix<T>::forRange(pool, level.nodes(), grain, [&](int b, int e) {invertDiagonal(level, b, e);});
+            }
+            factorCoarsest();
+        }
+
+        // z = one V-cycle applied to r
+        void apply(const std::vector<vec3>& r, std::vector<vec3>& z, ThreadPool* pool) {
+            Level& first = *levels[0];
+            std::copy(r.begin(), r.end(), first.b.begin());
+            cycle(0, pool);
+            std::copy(first.x.begin(), first.x.end(), z.begin());
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class Multigrid<float>;
+extern template class Multigrid<double>;
+#endif
@@ -0,0 +1,62 @@
+#include "Cloth.h"
+#include "World.h"
+#include "Simulation.h"
+
+// Explicit instantiations of the physics core. Every other translation unit
+// sees these as extern templates, so each precision is compiled only here.
+template struct Vertices<float>;
+template struct Vertices<double>;
+
+template class SpringDamper<float>;
+template class SpringDamper<double>;
+
+template class Triangle<float>;
+template class Triangle<double>;
+
+template class AttachmentTrack<float>;
+template class AttachmentTrack<double>;
+
+template class BlockMatrix<float>;
+template class BlockMatrix<double>;
+
+template class BlockAssembly<float>;
+template class BlockAssembly<double>;
+
+template class Chebyshev<float>;
+template class Chebyshev<double>;
+
+template class Multigrid<float>;
+template class Multigrid<double>;
+
+template class IncompleteCholesky<float>;
+template class IncompleteCholesky<double>;
+
+template class ImplicitSolver<float>;
+template class ImplicitSolver<double>;
+
+template class Cholesky<float>;
+template class Cholesky<double>;
+
+template class ProjectiveSolver<float>;
+template class ProjectiveSolver<double>;
+
+template class Collider<float>;
+template class Collider<double>;
+
+template class VelocityGrid<float>;
+template class VelocityGrid<double>;
+
+template class WindField<float>;
+template class WindField<double>;
+
+template class AirGrid<float>;
+template class AirGrid<double>;
+
+template class Cloth<float>;
+template class Cloth<double>;
+
+template class World<float>;
+template class World<double>;
+
+template class Simulation<float>;
+template class Simulation<double>;
@@ -0,0 +1,357 @@
+#ifndef _PROJECTIVE_SOLVER_H_
+#define _PROJECTIVE_SOLVER_H_
+
+#include "BlockMatrix.h"
+#include "Cholesky.h"
+#include "Chebyshev.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Projective dynamics (Bouaziz et al. 2014) for springs and linear bending.
+// A step minimizes the inertia |x - y|_M / 2h^2 plus the distance of every
+// spring to its rest length, by alternating a local step, which projects
+// each spring onto its rest length, and a global step, which solves
+//   (M / h^2 + L + B) x = M / h^2 y + sum of the projections
+// for the positions, where y is the position the vertices would coast to,
+// L the Laplacian of the springs weighted by their stiffness and B the
+// bending matrix. The system does not change between iterations or steps,
+// so it is factored once and refactored only when the step, the topology or
+// the constrained vertices change; the three coordinates share it and are
+// solved side by side. Adaptive steps come in a few lengths, a frame cut
+// into a whole number of substeps and the halves of retried ones, so the
+// factors of the last cachedSteps lengths are kept, each costing the memory
+// of one factor, and a length seen again is not factored again. The
+// unknowns are factored in the order of the grid the cloth was built on,
+// with every vertex split off by a tear next to the one it came from, which
+// keeps the envelope of the factor narrow. Spring and bending damping enter
+// as the same matrices times the damping over h, pulling the velocities
+// towards the mean of their neighbours. Constrained vertices keep their
+// positions. Held vertices, those of sleeping bands, are kept through the
+// right-hand side alone, which takes their rows of the system times the
+// current positions, so holding or releasing one does not refactor. The
+// iterations are accelerated by Chebyshev weights (Wang 2015).
+template <typename T>
+class ProjectiveSolver {
+    public:
+        typedef typename BlockMatrix<T>::vec3 vec3;
+
+    private:
+        static const int grain = 512;
+
+        // springs
+        std::vector<unsigned int> ends;
+        std::vector<T> stiffness;
+        std::vector<T> damping;
+        std::vector<T> rest;
+        std::vector<int> vertexStarts;
+        std::vector<int> vertexSprings;     // 2 s + the end the vertex is
+        std::vector<vec3> projections;
+
+        // bending, by rows
+        std::vector<int> bendingStarts;
+        std::vector<int> bendingColumns;
+        std::vector<T> bendingValues;
+        T bendingStiffness, bendingDamping;
+
+        // The system for one step length, in factor order, with the
+        // constrained couplings and with them removed and factored
+        struct Factor {
+            T step;
+            std::vector<T> coupled;
+            Cholesky<T> cholesky;
+            bool definite;
+        };
+        static const int cachedSteps = 4;
+
+        // the pattern of the system by rows in factor order, its factors,
+        // most recently used first, and the state they were factored for
+        std::vector<int> order;     // vertex of each row
+        std::vector<int> ranks;     // row of each vertex
+        std::vector<int> starts;
+        std::vector<int> columns;
+        std::vector<T> values;
+        std::vector<Factor> factors;
+        bool changed;
+        T factoredStep;
+        std::vector<T> masses;
+        std::vector<char> constrained;
+        int factorizations;
+        int failures;
+
+        std::vector<vec3> base;     // of the right-hand side, fixed over a step
+        std::vector<vec3> rhs;
+        std::vector<vec3> ordered;  // the right-hand side in factor order
+        std::vector<vec3> solution;
+        std::vector<vec3> older;    // the iterate before the last
+        std::vector<T> partials;
+
+        Chebyshev<T> chebyshev;
+        int iterations;
+
+        int rows() const {return (int)starts.size() - 1;}
+
+        void build(T h, Factor& f) {
+            int n = rows();
+            T weight = T(1) / (h * h);
+            std::vector<T>& coupled = f.coupled;
+            f.step = h;
+            coupled.assign(columns.size(), T(0));
+            auto add = [&](int i, int j, T value) {
+                i = ranks[i];
+                j = ranks[j];
+                int k = std::lower_bound(columns.begin() + starts[i], columns.begin() + starts[i + 1], j) - columns.begin();
+                coupled[k] += value;
+            };
+            for (int i = 0; i < n; i++) {
+                add(i, i, weight * masses[i]);
+            }
+            for (size_t s = 0; s < rest.size(); s++) {
+                int i = ends[2 * s], j = ends[2 * s + 1];
+                T w = stiffness[s] + damping[s] / h;
+                add(i, i, w);
+                add(j, j, w);
+                add(i, j, -w);
+                add(j, i, -w);
+            }
+            T wb = bendingStiffness + bendingDamping / h;
+            for (int i = 0; i < n; i++) {
+                for (int e = bendingStarts[i]; e < bendingStarts[i + 1]; e++) {
+                    add(i, bendingColumns[e], wb * bendingValues[e]);
+                }
+            }
+
+            values = coupled;
+            for (int i = 0; i < n; i++) {
+                for (int k = starts[i]; k < starts[i + 1]; k++) {
+                    if (constrained[order[i]] || constrained[order[columns[k]]]) {
+                        values[k] = (columns[k] == i) ? T(1) : T(0);
+                    }
+                }
+            }
+            f.definite = f.cholesky.compute(starts, columns, values);
+            if (!f.definite) failures++;
+            factorizations++;
+        }
+
+        // Sum of f over chunks of fixed size, in order
+        template <typename F>
+        T sum(ThreadPool* pool, int count, const F& f) {
+            int chunks = (count + grain - 1) / grain;
+            partials.assign(chunks, T(0));
+            BlockMatrix<T>::forRange(pool, chunks, 1, [&](int b, int e) {
+                for (int c = b; c < e; c++) {
+                    partials[c] = f(c * grain, std::min(count, (c + 1) * grain));
+                }
+            });
+            T total = 0;
+            for (auto p : partials) total += p;
+            return total;
+        }
+
+    public:
+        ProjectiveSolver() {
+            bendingStiffness = bendingDamping = 0;
+            changed = true;
+            factoredStep = 0;
+            factorizations = 0;
+            failures = 0;
+            iterations = 10;
+            starts.assign(1, 0);
+        }
+
+        // Springs s between ends[2 s] and ends[2 s + 1], and the bending
+        // matrix Q by rows, for the vertices on the given grid cells
+        void setTopology(const std::vector<int>& cells, const std::vector<unsigned int>& springEnds, const std::vector<T>& springStiffness,
+                         const std::vector<T>& springDamping, const std::vector<T>& restLengths,
+                         const std::vector<int>& qStarts, const std::vector<int>& qColumns, const std::vector<T>& qValues) {
+            int n = cells.size();
+            order.resize(n);
+            ranks.resize(n);
+            for (int i = 0; i < n; i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {return cells[a] < cells[b];});
+            for (int r = 0; r < n; r++) ranks[order[r]] = r;
+
+            ends = springEnds;
+            stiffness = springStiffness;
+            damping = springDamping;
+            rest = restLengths;
+            bendingStarts = qStarts;
+            bendingColumns = qColumns;
+            bendingValues = qValues;
+            projections.resize(rest.size());
+
+            vertexStarts.assign(n + 1, 0);
+            for (auto v : ends) vertexStarts[v + 1]++;
+            for (int i = 0; i < n; i++) vertexStarts[i + 1] += vertexStarts[i];
+            vertexSprings.resize(ends.size());
+            std::vector<int> fill(vertexStarts.begin(), vertexStarts.end() - 1);
+            for (size_t e = 0; e < ends.size(); e++) {
+                vertexSprings[fill[ends[e]]++] = e;
+            }
+
+            std::vector<std::pair<int, int> > pairs;
+            for (size_t s = 0; s < rest.size(); s++) {
+                pairs.push_back(std::make_pair(ranks[ends[2 * s]], ranks[ends[2 * s + 1]]));
+                pairs.push_back(std::make_pair(ranks[ends[2 * s + 1]], ranks[ends[2 * s]]));
+            }
+            for (int i = 0; i < n; i++) {
+                pairs.push_back(std::make_pair(ranks[i], ranks[i]));
+                for (int e = bendingStarts[i]; e < bendingStarts[i + 1]; e++) {
+                    pairs.push_back(std::make_pair(ranks[i], ranks[bendingColumns[e]]));
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+            starts.assign(n + 1, 0);
+            columns.resize(pairs.size());
+            for (size_t k = 0; k < pairs.size(); k++) {
+                starts[pairs[k].first + 1]++;
+                columns[k] = pairs[k].second;
+            }
+            for (int i = 0; i < n; i++) starts[i + 1] += starts[i];
+
+            base.resize(n);
+            rhs.resize(n);
+            ordered.resize(n);
+            solution.resize(n);
+            older.resize(n);
+            changed = true;
+        }
+
+        // Take the factor for a step of length h, dropping every factor
+        // if the masses, the bending or the constrained vertices differ from
+        // the ones they were made for. Returns false if the system is not
+        // definite, in which case the solution is not to be trusted.
+        bool prepare(T h, const std::vector<T>& m, const std::vector<char>& c, T kb, T kdb) {
+            if (changed || m != masses || c != constrained || kb != bendingStiffness || kdb != bendingDamping) {
+                masses = m;
+                constrained = c;
+                bendingStiffness = kb;
+                bendingDamping = kdb;
+                changed = false;
+                factors.clear();
+            }
+            factoredStep = h;
+            auto it = std::find_if(factors.begin(), factors.end(), [h](const Factor& f) {return f.step == h;});
+            if (it != factors.end()) {
+                std::rotate(factors.begin(), it, it + 1);
+            } else {
+                if ((int)factors.size() == cachedSteps) factors.pop_back();
+                factors.insert(factors.begin(), Factor());
+                build(h, factors.front());
+            }
+            return factors.front().definite;
+        }
+
+        // Positions after a step of length h from positions x to the
+        // inertial target y, with the held vertices kept at x as far as
+        // their neighbours let them, read with getSolution()
+        void solve(const std::vector<vec3>& x, const std::vector<vec3>& y, const std::vector<char>& held, ThreadPool* pool) {
+            int n = rows();
+            T h = factoredStep;
+            if (n == 0) return;
+            const std::vector<T>& coupled = factors.front().coupled;
+            const Cholesky<T>& cholesky = factors.front().cholesky;
+            BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                for (int i = b; i < e; i++) {
+                    if (constrained[i]) {
+                        base[i] = solution[i] = older[i] = x[i];
+                        continue;
+                    }
+                    int row = ranks[i];
+                    if (held[i]) {
+                        vec3 r = vec3(0);
+                        for (int k = starts[row]; k < starts[row + 1]; k++) {
+                            int j = order[columns[k]];
+                            if (!constrained[j]) r += coupled[k] * x[j];
+                        }
+                        base[i] = r;
+                        solution[i] = older[i] = x[i];
+                        continue;
+                    }
+                    vec3 r = masses[i] / (h * h) * y[i];
+                    for (int k = vertexStarts[i]; k < vertexStarts[i + 1]; k++) {
+                        int s = vertexSprings[k] / 2;
+                        int other = ends[vertexSprings[k] ^ 1];
+                        r += damping[s] / h * (x[i] - x[other]);
+                    }
+                    for (int e = bendingStarts[i]; e < bendingStarts[i + 1]; e++) {
+                        r += bendingDamping / h * bendingValues[e] * x[bendingColumns[e]];
+                    }
+                    // the couplings to constrained vertices move to this side
+                    for (int k = starts[row]; k < starts[row + 1]; k++) {
+                        int j = order[columns[k]];
+                        if (j != i && constrained[j]) r -= coupled[k] * x[j];
+                    }
+                    base[i] = r;
+                    solution[i] = older[i] = y[i];
+                }
+            });
+
+            chebyshev.start();
+            for (int iteration = 0; iteration < iterations; iteration++) {
+                // local step
+                BlockMatrix<T>::forRange(pool, rest.size(), 2 * grain, [&](int b, int e) {
+                    for (int s = b; s < e; s++) {
+                        vec3 delta = solution[ends[2 * s + 1]] - solution[ends[2 * s]];
+                        T length = glm::length(delta);
+                        projections[s] = rest[s] * ((length != 0) ? delta / length : vec3(0, 1, 0));
+                    }
+                });
+
+                // global step
+                BlockMatrix<T>::forRange(pool, n, grain, [&](int b, int e) {
+                    for (int i = b; i < e; i++) {
+                        vec3 r = base[i];
+                        if (!constrained[i] && !held[i]) {
+                            for (int k = vertexStarts[i]; k < vertexStarts[i + 1]; k++) {
+                                int s = vertexSprings[k] / 2;
+                                r += (vertexSprings[k] & 1) ? stiffness[s] * projections[s] : -stiffness[s] * projections[s];
+                            }
+                        }
+                        ordered[ranks[i]] = r;
+                    }
+                });
+                BlockMatrix<T>::forRange(pool, 3, 1, [&](int b, int e) {
+                    for (int c = b; c < e; c++) cholesky.solve(&ordered[0][c], 3);
+                });
+
+                T change = sum(pool, n, [&](int b, int e) {
+                    for (int i = b; i < e; i++) rhs[i] = ordered[ranks[i]];
+                    chebyshev.blend(rhs, older, b, e);
+                    T s = 0;
+                    for (int i = b; i < e; i++) {
+                        vec3 d = rhs[i] - solution[i];
+                        s += glm::dot(d, d);
+                    }
+                    return s;
+                });
+                older.swap(solution);
+                solution.swap(rhs);
+                chebyshev.next(change);
+            }
+        }
+
+        std::vector<vec3>& getSolution() {return solution;}
+
+        void setIterations(int count) {iterations = std::max(1, count);}
+        int getIterations() const {return iterations;}
+
+        // The acceleration of the iterations, and its estimate of their
+        // spectral radius
+        Chebyshev<T>& getChebyshev() {return chebyshev;}
+
+        // Since construction, to see how rarely the system changes
+        int getFactorizations() const {return factorizations;}
+
+        // Factorizations since construction that found the system not
+        // definite
+        int getFailures() const {return failures;}
+};
+
+// Instantiated once in Physics.cpp
+extern template class ProjectiveSolver<float>;
+extern template class ProjectiveSolver<double>;
+#endif
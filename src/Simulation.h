@@ -0,0 +1,127 @@
+#ifndef _SIMULATION_H_
+#define _SIMULATION_H_
+
+#include "World.h"
+#include "TripleBuffer.h"
+#include "CommandQueue.h"
+
+#include <chrono>
+
+// Input sent from the GL thread to the simulation thread
+struct Command {
+    enum Type {TRANSLATE, WIND, TEARING, MEMBRANE, INTEGRATOR};
+
+    Type type;
+    int cloth;          // index of the cloth in the world, unused by WIND
+    glm::vec3 value;    // offset, wind velocity, tear strain in x, membrane on when x != 0, or integrator in x
+
+    Command() : type(WIND), cloth(0), value(0) {}
+    Command(Type t, int c, glm::vec3 v) : type(t), cloth(c), value(v) {}
+};
+
+// Runs the world on its own thread at a fixed rate. The GL thread never
+// touches cloth state: it posts commands, which are applied between steps,
+// and picks up the newest published frames, so rendering and stepping
+// never wait on each other.
+template <typename T>
+class Simulation {
+    private:
+        World<T>* world;
+        int substeps;
+        std::chrono::nanoseconds period;
+
+        TripleBuffer<std::vector<ClothFrame> > frames;
+        CommandQueue<Command, 256> commands;
+
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<bool> paused;
+
+        void apply(const Command& command) {
+            if (command.type == Command::WIND) {
+                world->blowByWind(command.value);
+                return;
+            }
+
+            Cloth<T>* cloth = world->getCloth(command.cloth);
+            if (!cloth) return;
+            if (command.type == Command::TRANSLATE) {
+                cloth->translate(command.value);
+            } else if (command.type == Command::TEARING) {
+                cloth->setTearing(command.value.x);
+            } else if (command.type == Command::MEMBRANE) {
+                cloth->setMembrane(command.value.x != 0);
+            } else if (command.type == Command::INTEGRATOR) {
+                cloth->setIntegrator((typename Cloth<T>::Integrator)(int)command.value.x);
+            }
+        }
+
+        void loop() {
+            auto next = std::chrono::steady_clock::now();
+            while (running) {
+                Command command;
+                while (commands.pop(command)) {
+                    apply(command);
+                }
+
+                if (!paused) {
+                    world->step(substeps);
+                }
+                world->snapshot(frames.write());
+                frames.publish();
+
+                // Keep a fixed rate, but do not try to catch up after a slow step
+                next += period;
+                auto now = std::chrono::steady_clock::now();
+                if (next < now) {
+                    next = now;
+                } else {
+                    std::this_thread::sleep_until(next);
+                }
+            }
+        }
+
+    public:
+        // By default 10 substeps are taken every 1/60 of a second
+        Simulation(World<T>* w, int substeps = 10, double rate = 60.0) : running(false), paused(false) {
+            world = w;
+            this->substeps = substeps;
+            period = std::chrono::nanoseconds((long long)(1e9 / rate));
+        }
+
+        ~Simulation() {
+            stop();
+        }
+
+        void start() {
+            if (running) return;
+            running = true;
+            thread = std::thread(&Simulation::loop, this);
+        }
+
+        void stop() {
+            if (!running) return;
+            running = false;
+            thread.join();
+        }
+
+        void setPaused(bool p) {paused = p;}
+
+        // Returns false when the queue is full and the command was dropped
+        bool post(const Command& command) {return commands.push(command);}
+
+        // Upload the newest published frames, if any, on the GL thread
+        void upload() {
+            if (frames.update()) {
+                world->upload(frames.read());
+            }
+        }
+
+        // The frames last uploaded, on the GL thread
+        const std::vector<ClothFrame>& getFrames() {return frames.read();}
+};
+
+// Instantiated once in Physics.cpp
+extern template class Simulation<float>;
+extern template class Simulation<double>;
+#endif
@@ -3,57 +3,109 @@
 
 #include "utils.h"
 #include "iostream"
-#include "Vertex.h"
 
+// The parameters of a spring between two vertices, its first and second
+// end, whose state the cloth hands in: delta is the position of the second
+// end relative to the first, and relative its velocity
+template <typename T>
 class SpringDamper {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+
     private:
-        float ks;   // Spring Stiffness Coefficient
-        float kd;   // Damping Coefficient
-        Vertex* v1;
-        Vertex* v2;
-        float resistantLength;
+        T ks;   // Spring Stiffness Coefficient
+        T kd;   // Damping Coefficient
+        T resistantLength;
+        T tearLength;   // Length at which the spring breaks, 0 if unbreakable
 
     public:
-        SpringDamper(Vertex* v_1, Vertex* v_2, float rl) {
+        SpringDamper(T rl) {
             ks = 2000;
             kd = 12;
-            v1 = v_1;
-            v2 = v_2;
             resistantLength = rl;
+            tearLength = 0;
         }
-        
-        void updateAcceleration() {
-            float currentLength = glm::length(glm::vec3(v2->position - v1->position));
-            float dx = currentLength - resistantLength;
-            glm::vec3 direction = glm::vec3(0, 1, 0);
+
+        void setTearStrain(T strain) {tearLength = (strain > 0) ? (1 + strain) * resistantLength : 0;}
+
+        T getStiffness() const {return ks;}
+        T getDamping() const {return kd;}
+        T getRestLength() const {return resistantLength;}
+
+        // Spring and damping force on the first end; the second takes the
+        // opposite. Returns false, with no force, once a breakable spring
+        // has been stretched past its tear length.
+        bool computeForce(const vec3& delta, const vec3& relative, vec3& force) const {
+            T currentLength = glm::length(delta);
+            if (tearLength != 0 && currentLength > tearLength) {
+                force = vec3(0);
+                return false;
+            }
+
+            force = computeForce(delta, relative, ks, kd, resistantLength);
+            return true;
+        }
+
+        // The same for any spring, from the position and the velocity of its
+        // second end relative to its first
+        static vec3 computeForce(const vec3& delta, const vec3& relative, T ks, T kd, T rest) {
+            T currentLength = glm::length(delta);
+            T dx = currentLength - rest;
+            vec3 direction = vec3(0, 1, 0);
             if (currentLength != 0) {
-                direction = glm::normalize(v2->position - v1->position);
+                direction = glm::normalize(delta);
             }
 
-            if (currentLength > 1.2 * resistantLength) {
-                glm::vec3 center = (v1->position + v2->position) / 2.0f;
-                if (!v1->fixed) {
-                    v1->position = center - 0.6f * resistantLength * direction;
-                }
-                if (!v2->fixed) {
-                    v2->position = center + 0.6f * resistantLength * direction;
-                }
+            vec3 vClose = glm::dot(relative, direction) * direction;
+            return ks * dx * direction + kd * vClose;
+        }
+
+        // Derivatives of the force on the first end by the position and the
+        // velocity of the second; those by its own are the opposite, and the
+        // second end's force has the same with the ends swapped. A compressed
+        // spring keeps only its stiffness along itself, which leaves the
+        // matrix of an implicit step definite (Choi and Ko 2002). Torn
+        // springs have none.
+        void jacobian(const vec3& delta, glm::mat<3, 3, T, glm::defaultp>& stiffness, glm::mat<3, 3, T, glm::defaultp>& damping) const {
+            typedef glm::mat<3, 3, T, glm::defaultp> mat3;
+            T currentLength = glm::length(delta);
+            if ((tearLength != 0 && currentLength > tearLength) || currentLength == 0) {
+                stiffness = damping = mat3(T(0));
+                return;
+            }
+            vec3 direction = delta / currentLength;
+            mat3 along = glm::outerProduct(direction, direction);
+            T across = std::max(T(0), T(1) - resistantLength / currentLength);
+            stiffness = ks * (along + across * (mat3(T(1)) - along));
+            damping = kd * along;
+        }
+
+        // How to move the ends, of inverse masses w1 and w2, to bring the
+        // length between lower and upper times the rest length: the first
+        // by w1 times the correction returned, the second by -w2 times it.
+        // Fixed ends stay put, and breakable springs may stretch until they
+        // tear.
+        vec3 strainCorrection(const vec3& delta, T w1, T w2, T lower, T upper) const {
+            T currentLength = glm::length(delta);
+            T target = currentLength;
+            if (tearLength == 0 && currentLength > upper * resistantLength) {
+                target = upper * resistantLength;
             }
-            else if (currentLength < 0.5 * resistantLength) {
-                glm::vec3 center = (v2->position + v1->position) / 2.0f;
-                if (!v1->fixed) {
-                    v1->position = center - resistantLength * direction / 4.0f;
-                }
-                if (!v2->fixed) {
-                    v2->position = center + resistantLength * direction / 4.0f;
-                } 
+            else if (currentLength < lower * resistantLength) {
+                target = lower * resistantLength;
             }
 
-            glm::vec3 vClose = glm::dot(v2->velocity - v1->velocity, direction) * direction;
-            glm::vec3 force = ks * dx * direction + kd * vClose;
+            if (target == currentLength || w1 + w2 == 0) return vec3(0);
 
-            v1->addForce(force);
-            v2->addForce(-force);
+            vec3 direction = vec3(0, 1, 0);
+            if (currentLength != 0) {
+                direction = delta / currentLength;
+            }
+            return (currentLength - target) / (w1 + w2) * direction;
         }
 };
-#endif
\ No newline at end of file
+
+// Instantiated once in Physics.cpp
+extern template class SpringDamper<float>;
+extern template class SpringDamper<double>;
+#endif
@@ -0,0 +1,110 @@
+#ifndef _TASK_GRAPH_H_
+#define _TASK_GRAPH_H_
+
+#include "ThreadPool.h"
+
+// Dependency graph of chunked jobs run on a ThreadPool. Each node is a
+// kernel over an index range that is split into chunks once the node's last
+// predecessor finishes; the range size is read at that moment, so a node may
+// depend on data resized by the nodes before it. Nodes without a path
+// between them run concurrently, which keeps workers busy across what would
+// otherwise be a barrier after every phase.
+class TaskGraph {
+    public:
+        typedef std::function<void(int, int)> Kernel;
+        typedef std::function<int()> Size;
+
+    private:
+        struct Node {
+            Size size;
+            int grain;
+            Kernel kernel;
+            std::vector<int> successors;
+            int dependencies;
+            std::atomic<int> waiting;       // predecessors not finished yet
+            std::atomic<int> chunksLeft;
+        };
+
+        std::vector<Node*> nodes;   // reused between runs, only the first used are live
+        size_t used;
+        ThreadPool* pool;
+        ThreadPool::TaskGroup* group;
+
+        void launch(int n) {
+            Node* node = nodes[n];
+            int size = node->size();
+            int chunks = (size > 0) ? (size - 1) / node->grain + 1 : 0;
+            if (chunks == 0) {
+                complete(n);
+                return;
+            }
+
+            node->chunksLeft = chunks;
+            for (int c = 0; c < chunks; c++) {
+                int b = c * node->grain;
+                int e = (c == chunks - 1) ? size : b + node->grain;
+                pool->submit([this, n, b, e] {
+                    nodes[n]->kernel(b, e);
+                    if (--nodes[n]->chunksLeft == 0) complete(n);
+                }, group);
+            }
+        }
+
+        void complete(int n) {
+            for (auto s : nodes[n]->successors) {
+                if (--nodes[s]->waiting == 0) launch(s);
+            }
+        }
+
+    public:
+        TaskGraph() : used(0), pool(nullptr), group(nullptr) {}
+
+        ~TaskGraph() {
+            for (auto n : nodes) {
+                delete n;
+            }
+        }
+
+        void clear() {used = 0;}
+
+        // Add a node running kernel(chunkBegin, chunkEnd) over [0, size())
+        int add(Size size, int grain, Kernel kernel) {
+            if (used == nodes.size()) {
+                nodes.push_back(new Node());
+            }
+            Node* node = nodes[used];
+            node->size = std::move(size);
+            node->grain = std::max(1, grain);
+            node->kernel = std::move(kernel);
+            node->successors.clear();
+            node->dependencies = 0;
+            return used++;
+        }
+
+        // Add a node running a single serial task
+        int add(std::function<void()> task) {
+            return add([] {return 1;}, 1, [task](int, int) {task();});
+        }
+
+        // after starts only once before has finished; -1 means no dependency
+        void precede(int before, int after) {
+            if (before < 0) return;
+            nodes[before]->successors.push_back(after);
+            nodes[after]->dependencies++;
+        }
+
+        void run(ThreadPool& p) {
+            ThreadPool::TaskGroup running;
+            pool = &p;
+            group = &running;
+            for (size_t n = 0; n < used; n++) {
+                nodes[n]->waiting = nodes[n]->dependencies;
+            }
+            for (size_t n = 0; n < used; n++) {
+                if (nodes[n]->dependencies == 0) launch(n);
+            }
+            pool->wait(running);
+            group = nullptr;
+        }
+};
+#endif
@@ -0,0 +1,172 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing pool. Every worker owns a deque: it pops its own tasks from
+// the back and steals from the front of the other deques when it runs dry.
+// Threads outside the pool submit to a shared deque, and any thread waiting
+// on a TaskGroup runs queued tasks instead of blocking, so a pool with no
+// worker threads still makes progress on the caller.
+class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        // Counts the submitted tasks of a batch that have not finished yet
+        struct TaskGroup {
+            std::atomic<int> pending;
+            TaskGroup() : pending(0) {}
+        };
+
+    private:
+        typedef std::pair<Task, TaskGroup*> Job;
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<Job> jobs;
+        };
+
+        struct Identity {
+            ThreadPool* pool;
+            int index;
+        };
+
+        std::vector<Queue*> queues;     // one per worker, the last one is shared by outside threads
+        std::vector<std::thread> threads;
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        std::atomic<int> queued;
+        bool stopping;
+
+        static Identity& current() {
+            static thread_local Identity identity = {nullptr, -1};
+            return identity;
+        }
+
+        int self() {return (current().pool == this) ? current().index : (int)threads.size();}
+
+        bool popBack(int q, Job& job) {
+            std::lock_guard<std::mutex> guard(queues[q]->lock);
+            if (queues[q]->jobs.empty()) return false;
+            job = std::move(queues[q]->jobs.back());
+            queues[q]->jobs.pop_back();
+            return true;
+        }
+
+        bool popFront(int q, Job& job) {
+            std::lock_guard<std::mutex> guard(queues[q]->lock);
+            if (queues[q]->jobs.empty()) return false;
+            job = std::move(queues[q]->jobs.front());
+            queues[q]->jobs.pop_front();
+            return true;
+        }
+
+        // Run one task from our own deque, or else one stolen from another
+        bool tryRun(int q) {
+            if (queued.load(std::memory_order_relaxed) == 0) return false;
+
+            Job job;
+            bool found = popBack(q, job);
+            for (size_t k = 1; !found && k < queues.size(); k++) {
+                found = popFront((q + k) % queues.size(), job);
+            }
+            if (!found) return false;
+
+            queued--;
+            job.first();
+            if (job.second) job.second->pending--;
+            return true;
+        }
+
+        void workerLoop(int index) {
+            current().pool = this;
+            current().index = index;
+            while (true) {
+                if (tryRun(index)) continue;
+
+                std::unique_lock<std::mutex> guard(sleepLock);
+                wake.wait(guard, [this] {return stopping || queued > 0;});
+                if (stopping && queued == 0) return;
+            }
+        }
+
+    public:
+        // By default there is one worker per hardware thread besides the caller
+        ThreadPool(int threads = -1) : queued(0), stopping(false) {
+            if (threads < 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+            }
+            for (int i = 0; i <= threads; i++) {
+                queues.push_back(new Queue());
+            }
+            for (int i = 0; i < threads; i++) {
+                this->threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> guard(sleepLock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& t : threads) {
+                t.join();
+            }
+            for (auto q : queues) {
+                delete q;
+            }
+        }
+
+        // Number of threads that can run tasks at once, counting the caller
+        int concurrency() {return threads.size() + 1;}
+
+        void submit(Task task, TaskGroup* group = nullptr) {
+            if (group) group->pending++;
+
+            int q = self();
+            {
+                std::lock_guard<std::mutex> guard(queues[q]->lock);
+                queues[q]->jobs.push_back(Job(std::move(task), group));
+            }
+            queued++;
+            {
+                std::lock_guard<std::mutex> guard(sleepLock);
+            }
+            wake.notify_one();
+        }
+
+        // Help with queued work until every task of the group has finished
+        void wait(TaskGroup& group) {
+            int q = self();
+            while (group.pending > 0) {
+                if (!tryRun(q)) std::this_thread::yield();
+            }
+        }
+
+        // Calls f(chunkBegin, chunkEnd) over [begin, end) in chunks of grain
+        // and returns once all of them are done
+        template <typename F>
+        void parallelFor(int begin, int end, int grain, const F& f) {
+            if (end - begin <= grain) {
+                if (begin < end) f(begin, end);
+                return;
+            }
+
+            TaskGroup group;
+            for (int b = begin; b < end; b += grain) {
+                int e = std::min(end, b + grain);
+                submit([&f, b, e] {f(b, e);}, &group);
+            }
+            wait(group);
+        }
+};
+#endif
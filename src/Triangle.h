@@ -3,56 +3,283 @@
 
 #include "utils.h"
 #include "iostream"
-#include "Vertex.h"
 
+#include <cmath>
+
+// Orthotropic St. Venant-Kirchhoff material of the membrane model. The
+// stiffnesses are per unit width, in N/m, along the warp (the x axis of the
+// flat rest sheet), along the weft (its y axis) and in shear. Damping is a
+// time, in s, that turns the strain rate into extra strain.
+template <typename T>
+struct Membrane {
+    T warp, weft, shear;
+    T poisson;      // contraction of the weft under warp strain
+    T damping;
+
+    Membrane() : warp(2000), weft(2000), shear(500), poisson(T(0.3)), damping(T(0.002)) {}
+    Membrane(T warp, T weft, T shear, T poisson, T damping) : warp(warp), weft(weft), shear(shear), poisson(poisson), damping(damping) {}
+
+    // Plane stress: S = (c11 Euu + c12 Evv, c12 Euu + c22 Evv, 2 c33 Euv)
+    void coefficients(T& c11, T& c12, T& c22, T& c33) const {
+        T scale = T(1) / (T(1) - poisson * poisson * weft / warp);
+        c11 = warp * scale;
+        c12 = poisson * weft * scale;
+        c22 = weft * scale;
+        c33 = shear;
+    }
+};
+
+// The per-face work of a cloth for a batch of triangles at once: the drag
+// of the air on every face and the forces of the membrane model. Inputs and
+// outputs are stored lane by lane (structure of arrays) and every step of
+// computeWind() and computeMembrane() is a branch-free loop over the lanes,
+// so the compiler turns it into vector instructions, one lane per triangle.
+template <typename T>
+struct FaceBatch {
+    typedef glm::vec<3, T, glm::defaultp> vec3;
+    static const int lanes = 8;
+
+    // filled by Triangle::load
+    T p1[3][lanes], p2[3][lanes], p3[3][lanes];
+    T velocity[3][lanes];   // sum of the corner velocities
+    T drag[lanes];
+    T wind[3][lanes];       // velocity of the air, filled by the caller
+
+    // filled by Triangle::loadMembrane
+    T v1[3][lanes], v2[3][lanes], v3[3][lanes];
+    T restInverse[4][lanes];
+    T restArea[lanes];
+
+    // unit normal, zero for a degenerate triangle, and the force on each corner
+    T normal[3][lanes];
+    T force[3][lanes];
+
+    // membrane force on each corner
+    T corner[3][3][lanes];
+
+    void computeWind() {
+        for (int l = 0; l < lanes; l++) {
+            T e1x = p2[0][l] - p1[0][l], e1y = p2[1][l] - p1[1][l], e1z = p2[2][l] - p1[2][l];
+            T e2x = p3[0][l] - p1[0][l], e2y = p3[1][l] - p1[1][l], e2z = p3[2][l] - p1[2][l];
+            T cx = e1y * e2z - e1z * e2y;
+            T cy = e1z * e2x - e1x * e2z;
+            T cz = e1x * e2y - e1y * e2x;
+            T doubleArea = std::sqrt(cx * cx + cy * cy + cz * cz);
+
+            // selects written as arithmetic: a degenerate triangle, whose
+            // cross product is zero, is pushed along +y
+            T flat = T(doubleArea == 0);
+            T inverse = T(1) / (doubleArea + flat);
+            T nx = cx * inverse;
+            T ny = cy * inverse + flat;
+            T nz = cz * inverse;
+            normal[0][l] = nx;
+            normal[1][l] = cy * inverse;
+            normal[2][l] = nz;
+
+            T vx = velocity[0][l] / T(3) - wind[0][l];
+            T vy = velocity[1][l] / T(3) - wind[1][l];
+            T vz = velocity[2][l] / T(3) - wind[2][l];
+            T speed2 = vx * vx + vy * vy + vz * vz;
+            T speed = std::sqrt(speed2);
+            T crossArea = (doubleArea / T(2)) * (vx * nx + vy * ny + vz * nz) / (speed + T(speed == 0));
+
+            T magnitude = -drag[l] * speed2 * crossArea;
+            force[0][l] = magnitude * nx;
+            force[1][l] = magnitude * ny;
+            force[2][l] = magnitude * nz;
+        }
+    }
+
+    // F = Ds Dm^-1 maps the rest triangle onto the current one, the Green
+    // strain E = (F^T F - I) / 2 gives the stress S, and the corners take
+    // -area F S Dm^-T, the first two columns for corners 2 and 3
+    void computeMembrane(const Membrane<T>& material) {
+        T c11, c12, c22, c33;
+        material.coefficients(c11, c12, c22, c33);
+        T beta = material.damping;
+        for (int l = 0; l < lanes; l++) {
+            T i00 = restInverse[0][l], i01 = restInverse[1][l], i10 = restInverse[2][l], i11 = restInverse[3][l];
+            T e1x = p2[0][l] - p1[0][l], e1y = p2[1][l] - p1[1][l], e1z = p2[2][l] - p1[2][l];
+            T e2x = p3[0][l] - p1[0][l], e2y = p3[1][l] - p1[1][l], e2z = p3[2][l] - p1[2][l];
+            T w1x = v2[0][l] - v1[0][l], w1y = v2[1][l] - v1[1][l], w1z = v2[2][l] - v1[2][l];
+            T w2x = v3[0][l] - v1[0][l], w2y = v3[1][l] - v1[1][l], w2z = v3[2][l] - v1[2][l];
+
+            // columns of F, and of its rate of change
+            T fux = e1x * i00 + e2x * i10, fuy = e1y * i00 + e2y * i10, fuz = e1z * i00 + e2z * i10;
+            T fvx = e1x * i01 + e2x * i11, fvy = e1y * i01 + e2y * i11, fvz = e1z * i01 + e2z * i11;
+            T dux = w1x * i00 + w2x * i10, duy = w1y * i00 + w2y * i10, duz = w1z * i00 + w2z * i10;
+            T dvx = w1x * i01 + w2x * i11, dvy = w1y * i01 + w2y * i11, dvz = w1z * i01 + w2z * i11;
+
+            // strain, with the damping added as strain rate times a time
+            T euu = (fux * fux + fuy * fuy + fuz * fuz - T(1)) / T(2) + beta * (fux * dux + fuy * duy + fuz * duz);
+            T evv = (fvx * fvx + fvy * fvy + fvz * fvz - T(1)) / T(2) + beta * (fvx * dvx + fvy * dvy + fvz * dvz);
+            T euv = (fux * fvx + fuy * fvy + fuz * fvz) / T(2) + beta * (fux * dvx + fuy * dvy + fuz * dvz + fvx * dux + fvy * duy + fvz * duz) / T(2);
+            T suu = c11 * euu + c12 * evv;
+            T svv = c12 * euu + c22 * evv;
+            T suv = T(2) * c33 * euv;
+
+            // columns of P = F S, scaled by -area
+            T area = restArea[l];
+            T pux = -area * (fux * suu + fvx * suv), puy = -area * (fuy * suu + fvy * suv), puz = -area * (fuz * suu + fvz * suv);
+            T pvx = -area * (fux * suv + fvx * svv), pvy = -area * (fuy * suv + fvy * svv), pvz = -area * (fuz * suv + fvz * svv);
+            T f2x = pux * i00 + pvx * i01, f2y = puy * i00 + pvy * i01, f2z = puz * i00 + pvz * i01;
+            T f3x = pux * i10 + pvx * i11, f3y = puy * i10 + pvy * i11, f3z = puz * i10 + pvz * i11;
+            corner[0][0][l] = -f2x - f3x;
+            corner[0][1][l] = -f2y - f3y;
+            corner[0][2][l] = -f2z - f3z;
+            corner[1][0][l] = f2x;
+            corner[1][1][l] = f2y;
+            corner[1][2][l] = f2z;
+            corner[2][0][l] = f3x;
+            corner[2][1][l] = f3y;
+            corner[2][2][l] = f3z;
+        }
+    }
+};
+
+// The parameters of a face, whose corners the cloth hands in by their
+// positions and velocities
+template <typename T>
 class Triangle {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+
     private:
-        Vertex* v1;
-        Vertex* v2;
-        Vertex* v3;
-        float dragCoefficient;
-        float fluidDensity;
+        T dragCoefficient;
+        T fluidDensity;
+
+        // Rest shape of the membrane model: the inverse of the matrix of
+        // the edges from p1 in material coordinates, row by row, and the area
+        T restInverse[4];
+        T restArea;
 
     public:
-        Triangle(Vertex* v_1, Vertex* v_2, Vertex* v_3) {
-            v1 = v_1;
-            v2 = v_2;
-            v3 = v_3;
-            dragCoefficient = 1.28f;
-            fluidDensity = 1.225f;
-            updateNormal();
+        Triangle(const vec3& p1, const vec3& p2, const vec3& p3) {
+            dragCoefficient = T(1.28);
+            fluidDensity = T(1.225);
+            setRestShape(p1, p2, p3);
         }
-        
-        void updateNormal() {
-            glm::vec3 normal = glm::normalize(glm::cross(glm::vec3(v2->position - v1->position), glm::vec3(v3->position - v1->position)));
-            v1->normal += normal;
-            v2->normal += normal;
-            v3->normal += normal;
+
+        // Take the given shape as the rest shape. The cloth is flat in its
+        // xy plane, whose x and y axes are the warp and the weft.
+        void setRestShape(const vec3& p1, const vec3& p2, const vec3& p3) {
+            T a = p2.x - p1.x, b = p3.x - p1.x;
+            T c = p2.y - p1.y, d = p3.y - p1.y;
+            T det = a * d - b * c;
+            T inverse = (det != 0) ? T(1) / det : T(0);
+            restInverse[0] = d * inverse;
+            restInverse[1] = -b * inverse;
+            restInverse[2] = -c * inverse;
+            restInverse[3] = a * inverse;
+            restArea = std::abs(det) / T(2);
         }
 
-        void addWind(glm::vec3 velocityWind) {
-            glm::vec3 edge1 = glm::vec3(v2->position - v1->position);
-            glm::vec3 edge2 = glm::vec3(v3->position - v1->position);
-            float area = glm::length(glm::cross(edge1, edge2)) / 2.0f;
+        // Copy the corners, with the sum of their velocities, into one lane
+        // of a batch for FaceBatch::computeWind
+        void load(FaceBatch<T>& batch, int lane, const vec3& p1, const vec3& p2, const vec3& p3, const vec3& velocity) const {
+            for (int k = 0; k < 3; k++) {
+                batch.p1[k][lane] = p1[k];
+                batch.p2[k][lane] = p2[k];
+                batch.p3[k][lane] = p3[k];
+                batch.velocity[k][lane] = velocity[k];
+            }
+            batch.drag[lane] = fluidDensity * dragCoefficient / (T(2) * T(3));
+        }
 
-            glm::vec3 normal = glm::vec3(0, 1, 0);
-            if (area != 0) {
-                normal = glm::normalize(glm::cross(edge1, edge2));
+        // Add what FaceBatch::computeMembrane needs on top of load
+        void loadMembrane(FaceBatch<T>& batch, int lane, const vec3& v1, const vec3& v2, const vec3& v3) const {
+            for (int k = 0; k < 3; k++) {
+                batch.v1[k][lane] = v1[k];
+                batch.v2[k][lane] = v2[k];
+                batch.v3[k][lane] = v3[k];
             }
+            for (int k = 0; k < 4; k++) {
+                batch.restInverse[k][lane] = restInverse[k];
+            }
+            batch.restArea[lane] = restArea;
+        }
 
-            glm::vec3 velocityTriangle = (v1->velocity + v2->velocity + v3->velocity) / 3.0f;
-            
-            glm::vec3 vClose = velocityTriangle - velocityWind;
-            float crossArea = 0;
-            if (glm::length(vClose) != 0) {
-                crossArea = area * glm::dot(vClose, normal) / glm::length(vClose);
+        // Derivatives of the membrane forces for implicit integrators:
+        // dx[a][b] is the change of the force on corner a with the position
+        // of corner b, and dv[a][b] with its velocity. Damping is left out of
+        // dx, as is usual. A definite Jacobian drops the compressive part of
+        // the stress from the geometric stiffness, so that -dx never has a
+        // negative eigenvalue, as linear solvers for implicit steps need.
+        void membraneJacobian(const Membrane<T>& material, const vec3 p[3], const vec3 v[3], glm::mat<3, 3, T, glm::defaultp> dx[3][3], glm::mat<3, 3, T, glm::defaultp> dv[3][3], bool definite = false) const {
+            typedef glm::vec<2, T, glm::defaultp> vec2;
+            T c11, c12, c22, c33;
+            material.coefficients(c11, c12, c22, c33);
+
+            vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+            vec3 w1 = v[1] - v[0], w2 = v[2] - v[0];
+            vec3 F[2] = {e1 * restInverse[0] + e2 * restInverse[2], e1 * restInverse[1] + e2 * restInverse[3]};
+            vec3 D[2] = {w1 * restInverse[0] + w2 * restInverse[2], w1 * restInverse[1] + w2 * restInverse[3]};
+            T beta = material.damping;
+            T euu = (glm::dot(F[0], F[0]) - T(1)) / T(2) + beta * glm::dot(F[0], D[0]);
+            T evv = (glm::dot(F[1], F[1]) - T(1)) / T(2) + beta * glm::dot(F[1], D[1]);
+            T euv = glm::dot(F[0], F[1]) / T(2) + beta * (glm::dot(F[0], D[1]) + glm::dot(F[1], D[0])) / T(2);
+            T S[2][2] = {{c11 * euu + c12 * evv, T(2) * c33 * euv}, {T(2) * c33 * euv, c12 * euu + c22 * evv}};
+
+            // the stress of the geometric stiffness, clamped to its
+            // positive eigenvalues when asked to
+            T P[2][2] = {{S[0][0], S[0][1]}, {S[1][0], S[1][1]}};
+            if (definite) {
+                T mean = (S[0][0] + S[1][1]) / T(2);
+                T radius = std::sqrt((S[0][0] - S[1][1]) * (S[0][0] - S[1][1]) / T(4) + S[0][1] * S[0][1]);
+                T high = mean + radius, low = mean - radius;
+                if (high <= 0) {
+                    P[0][0] = P[0][1] = P[1][0] = P[1][1] = 0;
+                } else if (low < 0) {
+                    vec2 e = (std::abs(high - S[1][1]) > std::abs(high - S[0][0])) ? vec2(high - S[1][1], S[0][1]) : vec2(S[0][1], high - S[0][0]);
+                    e /= glm::length(e);
+                    for (int i = 0; i < 2; i++) {
+                        for (int j = 0; j < 2; j++) {
+                            P[i][j] = high * e[i] * e[j];
+                        }
+                    }
+                }
             }
 
-            glm::vec3 force = -fluidDensity * dragCoefficient * glm::dot(vClose, vClose) * crossArea * normal / (2.0f * 3.0f);  // Force on each vertex since also divided by 3
+            // corner a has the force -area F S w[a]
+            vec2 w[3];
+            w[1] = vec2(restInverse[0], restInverse[1]);
+            w[2] = vec2(restInverse[2], restInverse[3]);
+            w[0] = -w[1] - w[2];
 
-            v1->addForce(force);
-            v2->addForce(force);
-            v3->addForce(force);
+            for (int a = 0; a < 3; a++) {
+                for (int b = 0; b < 3; b++) {
+                    // moving corner b by d changes the strain by sym(F^T d w[b]^T),
+                    // so the stress changes linearly in u = F^T d; M u is the
+                    // change of S w[a]
+                    T M[2][2];
+                    for (int j = 0; j < 2; j++) {
+                        T u[2] = {T(j == 0), T(j == 1)};
+                        T duu = u[0] * w[b][0], dvv = u[1] * w[b][1], duv = (u[0] * w[b][1] + u[1] * w[b][0]) / T(2);
+                        T suu = c11 * duu + c12 * dvv, svv = c12 * duu + c22 * dvv, suv = T(2) * c33 * duv;
+                        M[0][j] = suu * w[a][0] + suv * w[a][1];
+                        M[1][j] = suv * w[a][0] + svv * w[a][1];
+                    }
+                    glm::mat<3, 3, T, glm::defaultp> stiffness(T(0));
+                    for (int i = 0; i < 2; i++) {
+                        for (int j = 0; j < 2; j++) {
+                            stiffness += M[i][j] * glm::outerProduct(F[i], F[j]);
+                        }
+                    }
+                    T geometric = 0;
+                    for (int i = 0; i < 2; i++) {
+                        for (int j = 0; j < 2; j++) {
+                            geometric += w[b][i] * P[i][j] * w[a][j];
+                        }
+                    }
+                    dx[a][b] = -restArea * (stiffness + geometric * glm::mat<3, 3, T, glm::defaultp>(T(1)));
+                    dv[a][b] = -restArea * beta * stiffness;
+                }
+            }
         }
 };
-#endif
\ No newline at end of file
+
+// Instantiated once in Physics.cpp
+extern template class Triangle<float>;
+extern template class Triangle<double>;
+#endif
@@ -0,0 +1,38 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+// Lock-free single writer, single reader handoff of the latest value. The
+// writer fills its back buffer and swaps it with the middle one; the reader
+// swaps its front buffer with the middle one whenever that holds something
+// newer. Neither side ever waits, and stale frames are simply overwritten.
+template <typename S>
+class TripleBuffer {
+    private:
+        static const int fresh = 4;     // set on middle while it holds an unread value
+
+        S buffers[3];
+        std::atomic<int> middle;
+        int back;       // owned by the writer
+        int front;      // owned by the reader
+
+    public:
+        TripleBuffer() : middle(1), back(0), front(2) {}
+
+        S& write() {return buffers[back];}
+
+        void publish() {
+            back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 3;
+        }
+
+        // Returns true when a newer value was picked up for read()
+        bool update() {
+            if (!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+            return true;
+        }
+
+        const S& read() {return buffers[front];}
+};
+#endif
@@ -0,0 +1,111 @@
+#ifndef _VELOCITY_GRID_H_
+#define _VELOCITY_GRID_H_
+
+#include "utils.h"
+
+#include <vector>
+
+// Air velocities on the nodes of a cube of cells, sampled with trilinear
+// interpolation. Grids that fill it differently derive from this one and
+// bump the version every time they change the velocities, so samplers know
+// when their cached values are stale.
+template <typename T>
+class VelocityGrid {
+    public:
+        typedef glm::vec<3, T, glm::defaultp> vec3;
+
+    protected:
+        vec3 origin;
+        T cellSize;
+        int resolution;     // cells along each axis, nodes are one more
+        int nodes;
+        std::vector<T> velocity[3];
+        unsigned long long version;
+
+        int index(int i, int j, int k) const {return (k * nodes + j) * nodes + i;}
+
+        vec3 position(int n) const {
+            return origin + cellSize * vec3(n % nodes, (n / nodes) % nodes, n / (nodes * nodes));
+        }
+
+        // The eight nodes around a point and their trilinear weights. Points
+        // outside the cube are moved onto its nearest face.
+        void cell(T x, T y, T z, int corners[8], T weights[8]) const {
+            T scale = T(1) / cellSize;
+            T top = T(resolution);
+            T fx = std::min(std::max((x - origin.x) * scale, T(0)), top);
+            T fy = std::min(std::max((y - origin.y) * scale, T(0)), top);
+            T fz = std::min(std::max((z - origin.z) * scale, T(0)), top);
+            int i = std::min((int)fx, resolution - 1);
+            int j = std::min((int)fy, resolution - 1);
+            int k = std::min((int)fz, resolution - 1);
+            T tx = fx - T(i), ty = fy - T(j), tz = fz - T(k);
+
+            int n = index(i, j, k);
+            int slice = nodes * nodes;
+            corners[0] = n;                 weights[0] = (1 - tx) * (1 - ty) * (1 - tz);
+            corners[1] = n + 1;             weights[1] = tx * (1 - ty) * (1 - tz);
+            corners[2] = n + nodes;         weights[2] = (1 - tx) * ty * (1 - tz);
+            corners[3] = n + nodes + 1;     weights[3] = tx * ty * (1 - tz);
+            corners[4] = n + slice;         weights[4] = (1 - tx) * (1 - ty) * tz;
+            corners[5] = n + slice + 1;     weights[5] = tx * (1 - ty) * tz;
+            corners[6] = n + slice + nodes; weights[6] = (1 - tx) * ty * tz;
+            corners[7] = n + slice + nodes + 1; weights[7] = tx * ty * tz;
+        }
+
+        // sample() over any three node arrays
+        void interpolate(const std::vector<T>* field, const T* x, const T* y, const T* z, T* u, T* v, T* w, int count) const {
+            const T* fx = field[0].data();
+            const T* fy = field[1].data();
+            const T* fz = field[2].data();
+            for (int p = 0; p < count; p++) {
+                int corners[8];
+                T weights[8];
+                cell(x[p], y[p], z[p], corners, weights);
+
+                T su = 0, sv = 0, sw = 0;
+                for (int c = 0; c < 8; c++) {
+                    su += weights[c] * fx[corners[c]];
+                    sv += weights[c] * fy[corners[c]];
+                    sw += weights[c] * fz[corners[c]];
+                }
+                u[p] = su;
+                v[p] = sv;
+                w[p] = sw;
+            }
+        }
+
+    public:
+        // A cube of resolution^3 cells with its lowest corner at origin
+        VelocityGrid(glm::vec3 origin, T size, int resolution) {
+            this->origin = vec3(origin);
+            this->resolution = std::max(1, resolution);
+            cellSize = size / T(this->resolution);
+            nodes = this->resolution + 1;
+            version = 0;
+            for (int c = 0; c < 3; c++) {
+                velocity[c].assign(nodes * nodes * nodes, T(0));
+            }
+        }
+
+        int nodeCount() const {return nodes * nodes * nodes;}
+
+        unsigned long long getVersion() const {return version;}
+
+        // Trilinear samples at count points, given and returned as separate
+        // coordinate arrays. The loop has no branches so it is vectorized.
+        void sample(const T* x, const T* y, const T* z, T* u, T* v, T* w, int count) const {
+            interpolate(velocity, x, y, z, u, v, w, count);
+        }
+
+        vec3 sample(vec3 p) const {
+            vec3 result;
+            sample(&p.x, &p.y, &p.z, &result.x, &result.y, &result.z, 1);
+            return result;
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class VelocityGrid<float>;
+extern template class VelocityGrid<double>;
+#endif
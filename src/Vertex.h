@@ -3,40 +3,68 @@
 
 #include "utils.h"
 
-class Vertex {
-    private:
-        float mass;
-        bool fixed;
-        glm::vec3 normal;
-        glm::vec3 position;
-        glm::vec3 velocity;
-        glm::vec3 acceleration;
-
-        friend class Cloth;
-        friend class Triangle;
-        friend class SpringDamper;
-
-    public:
-        Vertex(float m, glm::vec3 p, glm::vec3 v) {
-            mass = m;
-            fixed = false;
-            normal = glm::vec3(0);
-            position = p;
-            velocity = v;
-            acceleration = glm::vec3(0);
-        }
+#include <vector>
+
+// The vertices of a cloth, one array per quantity (structure of arrays), so
+// the passes over them stream through memory. Pinned vertices have an
+// inverse mass of 0, so forces never move them and no loop branches on them.
+template <typename T>
+struct Vertices {
+    typedef glm::vec<3, T, glm::defaultp> vec3;
+
+    std::vector<vec3> position;
+    std::vector<vec3> velocity;
+    std::vector<vec3> force;        // of the last force pass, gravity included
+    std::vector<vec3> normal;
+    std::vector<T> mass;
+    std::vector<T> inverseMass;     // 0 while pinned
+
+    size_t size() const {return position.size();}
 
-        void fix() {fixed = true;}
-        void unfix() {fixed = false;}
-        void resetAcceleration() {acceleration = glm::vec3(0);}
-        void addAcceleration(glm::vec3 a) {acceleration += a;}
-        void addForce(glm::vec3 f) {acceleration += (f / mass);}
+    void add(T m, vec3 p, vec3 v) {
+        position.push_back(p);
+        velocity.push_back(v);
+        force.push_back(vec3(0));
+        normal.push_back(vec3(0));
+        mass.push_back(m);
+        inverseMass.push_back(T(1) / m);
+    }
 
-        void move(float dx) {
-            if (!fixed) {
-                velocity += (dx * acceleration);
-                position += (dx * velocity);
+    // Append a copy of vertex i
+    void duplicate(size_t i) {
+        position.push_back(position[i]);
+        velocity.push_back(velocity[i]);
+        force.push_back(force[i]);
+        normal.push_back(normal[i]);
+        mass.push_back(mass[i]);
+        inverseMass.push_back(inverseMass[i]);
+    }
+
+    void setFixed(size_t i, bool f) {inverseMass[i] = f ? T(0) : T(1) / mass[i];}
+    bool isFixed(size_t i) const {return inverseMass[i] == 0;}
+    void setMass(size_t i, T m) {
+        mass[i] = m;
+        if (!isFixed(i)) inverseMass[i] = T(1) / m;
+    }
+
+    // Semi-implicit Euler over [begin, end), as multiply-adds over the
+    // coordinates; pins keep the velocity of their targets
+    void move(int begin, int end, T h) {
+        T* x = &position[0][0];
+        T* v = &velocity[0][0];
+        const T* f = &force[0][0];
+        const T* w = inverseMass.data();
+        for (int i = begin; i < end; i++) {
+            T s = h * w[i];
+            for (int k = 0; k < 3; k++) {
+                v[3 * i + k] += s * f[3 * i + k];
+                x[3 * i + k] += h * v[3 * i + k];
             }
         }
+    }
 };
-#endif
\ No newline at end of file
+
+// Instantiated once in Physics.cpp
+extern template struct Vertices<float>;
+extern template struct Vertices<double>;
+#endif
@@ -0,0 +1,217 @@
+#ifndef _WIND_FIELD_H_
+#define _WIND_FIELD_H_
+
+#include "utils.h"
+#include "VelocityGrid.h"
+#include "TaskGraph.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+// Spatially varying wind over a box, stored on a coarse VelocityGrid. The
+// velocity at a node
+// is the base wind scaled by a gust factor, plus every directional source
+// and a turbulent part, the curl of a noise potential, so turbulence moves
+// air around without creating or removing any. The grid is rebuilt once per
+// frame, while cloths sample it every substep.
+template <typename T>
+class WindField : public VelocityGrid<T> {
+    public:
+        typedef typename VelocityGrid<T>::vec3 vec3;
+
+        // Blows velocity over the nodes within radius of position
+        struct Source {
+            vec3 position;
+            vec3 velocity;
+            T radius;
+        };
+
+    private:
+        static const int octaves = 3;
+
+        using VelocityGrid<T>::origin;
+        using VelocityGrid<T>::cellSize;
+        using VelocityGrid<T>::resolution;
+        using VelocityGrid<T>::nodes;
+        using VelocityGrid<T>::velocity;
+        using VelocityGrid<T>::version;
+        using VelocityGrid<T>::index;
+        using VelocityGrid<T>::position;
+
+        vec3 base;
+        T turbulence;       // rough speed of the turbulent part, in m/s
+        T turbulenceScale;  // size of the largest eddies, in m
+        T gustStrength;     // largest relative change of the base wind
+        std::vector<Source> sources;
+        T time;
+
+        // Noise potential made of sine waves, one set per component. A wave
+        // factors into one phase per axis and one for time, so the nodes
+        // take products of unit complex numbers from per-axis tables
+        // instead of evaluating a sine each.
+        vec3 waveNumbers[3][octaves];
+        T phases[3][octaves];
+        T amplitudes[3][octaves];
+        std::vector<std::complex<T> > axisPhases[3][octaves][3];
+        std::complex<T> timePhases[3][octaves];
+
+        std::vector<T> potential[3];
+
+        // Without the checks for infinities of operator*, which are slow
+        static std::complex<T> multiply(const std::complex<T>& a, const std::complex<T>& b) {
+            return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+        }
+
+        T gust() const {
+            return T(1) + gustStrength * (T(0.5) * std::sin(T(0.7) * time) + T(0.3) * std::sin(T(1.9) * time + T(1)) + T(0.2) * std::sin(T(4.3) * time + T(2)));
+        }
+
+        // Pick wave directions and phases with a fixed seed, so every run
+        // blows the same way
+        void seed() {
+            unsigned int state = 12345u;
+            auto random = [&state] {
+                state = state * 1664525u + 1013904223u;
+                return T(state >> 8) / T(1 << 24);
+            };
+            for (int c = 0; c < 3; c++) {
+                for (int o = 0; o < octaves; o++) {
+                    T z = T(2) * random() - T(1);
+                    T a = glm::two_pi<T>() * random();
+                    T r = std::sqrt(T(1) - z * z);
+                    T frequency = glm::two_pi<T>() / turbulenceScale * T(1 << o);
+                    waveNumbers[c][o] = frequency * vec3(r * std::cos(a), r * std::sin(a), z);
+                    phases[c][o] = glm::two_pi<T>() * random();
+                    // the curl scales with frequency, and each octave halves in speed
+                    amplitudes[c][o] = turbulence / frequency / T(1 << o);
+
+                    for (int a = 0; a < 3; a++) {
+                        axisPhases[c][o][a].resize(nodes);
+                        for (int i = 0; i < nodes; i++) {
+                            axisPhases[c][o][a][i] = std::polar(T(1), waveNumbers[c][o][a] * (origin[a] + cellSize * i));
+                        }
+                    }
+                }
+            }
+        }
+
+    public:
+        using VelocityGrid<T>::nodeCount;
+
+        // A cube of resolution^3 cells with its lowest corner at origin
+        WindField(glm::vec3 origin, T size, int resolution) : VelocityGrid<T>(origin, size, resolution) {
+            base = vec3(0);
+            turbulence = 0;
+            turbulenceScale = 4;
+            gustStrength = 0;
+            time = 0;
+            seed();
+
+            for (int c = 0; c < 3; c++) {
+                potential[c].assign(nodes * nodes * nodes, T(0));
+            }
+        }
+
+        void setWind(glm::vec3 wind) {base = vec3(wind);}
+
+        void setTurbulence(T speed, T scale) {
+            turbulence = speed;
+            turbulenceScale = scale;
+            seed();
+        }
+
+        void setGusts(T strength) {gustStrength = strength;}
+
+        void addSource(glm::vec3 position, glm::vec3 velocity, T radius) {
+            Source s = {vec3(position), vec3(velocity), radius};
+            sources.push_back(s);
+        }
+
+        // Phase kernels over node ranges, in the same style as Cloth
+
+        // each octave drifts twice as fast as the one before
+        void advance(T dt) {
+            time += dt;
+            version++;
+            for (int c = 0; c < 3; c++) {
+                for (int o = 0; o < octaves; o++) {
+                    timePhases[c][o] = amplitudes[c][o] * std::polar(T(1), phases[c][o] + T(1 << o) * time);
+                }
+            }
+        }
+
+        void updatePotential(int begin, int end) {
+            for (int n = begin; n < end; n++) {
+                int i = n % nodes, j = (n / nodes) % nodes, k = n / (nodes * nodes);
+                for (int c = 0; c < 3; c++) {
+                    T psi = 0;
+                    for (int o = 0; o < octaves; o++) {
+                        psi += std::imag(multiply(multiply(axisPhases[c][o][0][i], axisPhases[c][o][1][j]), multiply(axisPhases[c][o][2][k], timePhases[c][o])));
+                    }
+                    potential[c][n] = psi;
+                }
+            }
+        }
+
+        // Curl of the potential by central differences, one-sided on the
+        // faces of the box, plus the gusting base wind and the sources
+        void updateVelocity(int begin, int end) {
+            vec3 wind = base * gust();
+            for (int n = begin; n < end; n++) {
+                int i = n % nodes, j = (n / nodes) % nodes, k = n / (nodes * nodes);
+                int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, resolution);
+                int j0 = std::max(j - 1, 0), j1 = std::min(j + 1, resolution);
+                int k0 = std::max(k - 1, 0), k1 = std::min(k + 1, resolution);
+                T dx = cellSize * (i1 - i0), dy = cellSize * (j1 - j0), dz = cellSize * (k1 - k0);
+
+                auto d = [&](int c, int a, int b, T h) {return (potential[c][a] - potential[c][b]) / h;};
+                T dPzDy = d(2, index(i, j1, k), index(i, j0, k), dy);
+                T dPyDz = d(1, index(i, j, k1), index(i, j, k0), dz);
+                T dPxDz = d(0, index(i, j, k1), index(i, j, k0), dz);
+                T dPzDx = d(2, index(i1, j, k), index(i0, j, k), dx);
+                T dPyDx = d(1, index(i1, j, k), index(i0, j, k), dx);
+                T dPxDy = d(0, index(i, j1, k), index(i, j0, k), dy);
+                vec3 v = wind + vec3(dPzDy - dPyDz, dPxDz - dPzDx, dPyDx - dPxDy);
+
+                vec3 p = position(n);
+                for (auto& s : sources) {
+                    T falloff = T(1) - glm::dot(p - s.position, p - s.position) / (s.radius * s.radius);
+                    if (falloff > 0) v += s.velocity * falloff * falloff;
+                }
+
+                velocity[0][n] = v.x;
+                velocity[1][n] = v.y;
+                velocity[2][n] = v.z;
+            }
+        }
+
+        // Rebuild the grid for a frame of length dt
+        void update(T dt) {
+            advance(dt);
+            updatePotential(0, nodeCount());
+            updateVelocity(0, nodeCount());
+        }
+
+        // The same as update, as chunked nodes after node `after`; returns
+        // the node after which the field may be sampled
+        int schedule(TaskGraph& graph, int after, T dt) {
+            const int grain = 512;
+            TaskGraph::Size count = [this] {return nodeCount();};
+
+            int advanced = graph.add([this, dt] {advance(dt);});
+            graph.precede(after, advanced);
+            int potentials = graph.add(count, grain, [this](int b, int e) {updatePotential(b, e);});
+            graph.precede(advanced, potentials);
+            int velocities = graph.add(count, grain, [this](int b, int e) {updateVelocity(b, e);});
+            graph.precede(potentials, velocities);
+            return velocities;
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class WindField<float>;
+extern template class WindField<double>;
+#endif
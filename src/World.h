@@ -0,0 +1,171 @@
+#ifndef _WORLD_H_
+#define _WORLD_H_
+
+#include "utils.h"
+#include "Cloth.h"
+#include "Collider.h"
+#include "TaskGraph.h"
+#include "WindField.h"
+#include "AirGrid.h"
+
+// Scene owning every cloth and collider. Cloths never interact with each
+// other, so the substeps of all cloths go into one task graph on the shared
+// pool, each cloth a chain of chunked phases that interleaves with the
+// others, while uploads and draws stay on the GL thread.
+template <typename T>
+class World {
+    private:
+        ThreadPool* pool;
+        std::vector<Cloth<T>*> cloths;
+        std::vector<Collider<T> > colliders;
+        WindField<T>* windField;
+        std::vector<AirGrid<T>*> airGrids;
+        glm::vec3 wind;
+        TaskGraph graph;
+
+    public:
+        World(ThreadPool* p) {
+            pool = p;
+            windField = nullptr;
+            wind = glm::vec3(0);
+        }
+
+        ~World() {
+            for (auto c : cloths) {
+                delete c;
+            }
+        }
+
+        Cloth<T>* addCloth(Cloth<T>* cloth) {
+            if (!cloth->getAirGrid()) cloth->setWindField(windField);
+            cloth->setThreadPool(pool);
+            cloths.push_back(cloth);
+            return cloth;
+        }
+
+        void addCollider(const Collider<T>& collider) {colliders.push_back(collider);}
+
+        const std::vector<Cloth<T>*>& getCloths() {return cloths;}
+
+        Cloth<T>* getCloth(size_t i) {return (i < cloths.size()) ? cloths[i] : nullptr;}
+
+        // The field is not owned; nullptr goes back to uniform wind. Air
+        // grids take it as their ambient wind.
+        void setWindField(WindField<T>* field) {
+            windField = field;
+            for (auto g : airGrids) {
+                g->setAmbient(field);
+            }
+            for (auto c : cloths) {
+                if (!c->getAirGrid()) c->setWindField(field);
+            }
+        }
+
+        // Couple a cloth both ways to an air grid, which is not owned and
+        // may be shared by several cloths; nullptr uncouples the cloth
+        void setAirGrid(Cloth<T>* cloth, AirGrid<T>* grid) {
+            if (grid && std::find(airGrids.begin(), airGrids.end(), grid) == airGrids.end()) {
+                grid->setAmbient(windField);
+                grid->setWind(wind);
+                airGrids.push_back(grid);
+            }
+            if (grid) {
+                cloth->setAirGrid(grid);
+            } else {
+                cloth->setWindField(windField);
+            }
+        }
+
+        void blowByWind(glm::vec3 wind) {
+            this->wind = wind;
+            if (windField) windField->setWind(wind);
+            for (auto g : airGrids) {
+                g->setWind(wind);
+            }
+            for (auto c : cloths) {
+                c->blowByWind(wind);
+            }
+        }
+
+        // Advance every cloth by the given number of substeps, then upload
+        void update(int substeps) {
+            step(substeps);
+            for (auto c : cloths) {
+                c->upload();
+            }
+        }
+
+        // Advance every cloth by a frame of the given number of 1 ms substeps,
+        // without GL. Adaptive cloths cut the frame their own way, and
+        // sleeping cloths only check their wind. The wind field and the air grids take one step for all of them,
+        // each grid after its cloths have added their drag to it.
+        void step(int substeps) {
+            T frame = T(0.001) * substeps;
+            graph.clear();
+            int field = -1;
+            if (windField) {
+                field = windField->schedule(graph, -1, frame);
+            }
+
+            std::vector<int> airReady;
+            for (auto g : airGrids) {
+                int last = field;
+                for (auto c : cloths) {
+                    if (c->getAirGrid() != g) continue;
+                    int injected = graph.add([c] {c->injectAir();});
+                    graph.precede(last, injected);
+                    last = injected;
+                }
+                airReady.push_back(g->schedule(graph, last, frame));
+            }
+
+            for (auto c : cloths) {
+                int last = field;
+                if (c->getAirGrid()) {
+                    last = airReady[std::find(airGrids.begin(), airGrids.end(), c->getAirGrid()) - airGrids.begin()];
+                }
+                if (c->isAsleep()) {
+                    if (c->getAirGrid() || windField) {
+                        int idle = graph.add([c, frame] {c->idle(frame);});
+                        graph.precede(last, idle);
+                    }
+                    continue;
+                }
+                int count = c->planFrame(frame, substeps);
+                for (int s = 0; s < count; s++) {
+                    last = c->schedule(graph, last, &colliders);
+                }
+            }
+            graph.run(*pool);
+        }
+
+        void snapshot(std::vector<ClothFrame>& frames) {
+            frames.resize(cloths.size());
+            for (size_t i = 0; i < cloths.size(); i++) {
+                cloths[i]->snapshot(frames[i]);
+            }
+        }
+
+        void upload(const std::vector<ClothFrame>& frames) {
+            for (size_t i = 0; i < cloths.size() && i < frames.size(); i++) {
+                cloths[i]->upload(frames[i]);
+            }
+        }
+
+        // Draw all cloths in one pass with the shader bound once
+        void display(const glm::mat4& viewProjMatrix, GLuint shader) {
+            glUseProgram(shader);
+            glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMatrix);
+
+            for (auto c : cloths) {
+                c->draw(shader);
+            }
+
+            glUseProgram(0);
+        }
+};
+
+// Instantiated once in Physics.cpp
+extern template class World<float>;
+extern template class World<double>;
+#endif
@@ -1,6 +1,8 @@
 #include "utils.h"
 #include "Camera.h"
 #include "Cloth.h"
+#include "World.h"
+#include "Simulation.h"
 
 #include <GLFW/glfw3.h>
 #include <stdlib.h>
@@ -17,6 +19,9 @@
 #include <fstream>
 
 bool pause;
+bool tearing;
+bool membrane;
+int integrator;
 bool wireMode;
 bool cullingMode;
 
@@ -33,7 +38,13 @@ int height;
 const char* windowName;
 
 // Objects to render
-static Cloth* cloth;
+static ThreadPool* pool;
+static World<float>* world;
+static WindField<float>* windField;
+static AirGrid<float>* airGrid;
+static Simulation<float>* simulation;
+static const int cloth = 0;		// the cloth driven by the keyboard
+static int solverFailures = 0;	// reported so far
 
 // Shader Program 
 static GLuint shaderProgram;
@@ -149,8 +160,28 @@ bool initializeProgram() {
 }
 
 bool initializeObjects() {
-	cloth = new Cloth(50, 50, glm::vec3(0, 0, 0));																							// Segementation Fault here
-	cloth->blowByWind(wind);
+	pool = new ThreadPool();
+	world = new World<float>(pool);
+
+	// gusty, turbulent wind over a box around the cloth
+	windField = new WindField<float>(glm::vec3(-6, -9, -6), 12, 12);
+	windField->setTurbulence(1.5f, 4.0f);
+	windField->setGusts(0.4f);
+	world->setWindField(windField);
+
+	Cloth<float>* flag = world->addCloth(new Cloth<float>(50, 50, glm::vec3(0, 0, 0)));																							// Segementation Fault here
+
+	// air around the cloth that it slows down and is blown by in turn
+	airGrid = new AirGrid<float>(glm::vec3(-4, -5, -4), 8, 12);
+	world->setAirGrid(flag, airGrid);
+
+	// substeps sized by their error, so a calm cloth takes fewer
+	flag->setAdaptive(true);
+	world->blowByWind(wind);
+
+	// From here on only the simulation thread touches the cloths
+	simulation = new Simulation<float>(world);
+	simulation->start();
 	return true;
 }
 
@@ -204,8 +235,17 @@ void updateFrame(GLFWwindow* window) {
     // Clear the color and depth buffers.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	
 
-	// Render the object.
-	cloth->display(cam->GetViewProjectMatrix(), shaderProgram);
+	// Render the objects, with the newest frame from the simulation thread.
+	simulation->upload();
+	world->display(cam->GetViewProjectMatrix(), shaderProgram);
+
+	// Report the projective systems that could not be factored since the last frame
+	int failures = 0;
+	for (auto& frame : simulation->getFrames()) failures += frame.solverFailures;
+	if (failures > solverFailures) {
+		std::cerr << "Projective dynamics: the global matrix is not definite" << std::endl;
+		solverFailures = failures;
+	}
 
 	// Gets events, including input such as keyboard and mouse or window resizing.
 	glfwPollEvents();
@@ -215,18 +255,7 @@ void updateFrame(GLFWwindow* window) {
 	// Perform any updates as necessary. 
 	cam->update();
 
-	if (!pause) {
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-            cloth->update();
-	}
+	simulation->setPaused(pause);
 }
 
 void keyPressDetect(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -235,65 +264,94 @@ void keyPressDetect(GLFWwindow* window, int key, int scancode, int action, int m
 
 			// cloth control
 			case GLFW_KEY_W:
-				cloth->translate(glm::vec3(0, 0, -0.05));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(0, 0, -0.05)));
 				break;
 
 			case GLFW_KEY_S:
-				cloth->translate(glm::vec3(0, 0, 0.05));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(0, 0, 0.05)));
 				break;
 
 			case GLFW_KEY_A:
-				cloth->translate(glm::vec3(-0.05, 0, 0));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(-0.05, 0, 0)));
 				break;
 
 			case GLFW_KEY_D:
-				cloth->translate(glm::vec3(0.05, 0, 0));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(0.05, 0, 0)));
 				break;
 
 			case GLFW_KEY_LEFT_SHIFT:
-				cloth->translate(glm::vec3(0, 0.05, 0));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(0, 0.05, 0)));
 				break;
 
 			case GLFW_KEY_LEFT_CONTROL:
-				cloth->translate(glm::vec3(0, -0.05, 0));
+				simulation->post(Command(Command::TRANSLATE, cloth, glm::vec3(0, -0.05, 0)));
+				break;
+
+			// tearing control
+			// the toggles only change once the simulation has taken the command
+			case GLFW_KEY_T:
+				if (simulation->post(Command(Command::TEARING, cloth, glm::vec3(!tearing ? 0.15f : 0.0f)))) {
+					tearing = !tearing;
+					std::cerr << "Tearing: " << (tearing ? "on" : "off") << std::endl;
+				}
+				break;
+
+			// membrane model control
+			case GLFW_KEY_M:
+				if (simulation->post(Command(Command::MEMBRANE, cloth, glm::vec3(!membrane ? 1.0f : 0.0f)))) {
+					membrane = !membrane;
+					std::cerr << "Model: " << (membrane ? "membrane" : "springs") << std::endl;
+				}
+				break;
+
+			// integrator control
+			case GLFW_KEY_E:
+				if (simulation->post(Command(Command::INTEGRATOR, cloth, glm::vec3((float)((integrator + 1) % 4))))) {
+					integrator = (integrator + 1) % 4;
+					std::cerr << "Integrator: " << (integrator == 0 ? "explicit" : integrator == 1 ? "implicit" : integrator == 2 ? "projective" : "Verlet") << std::endl;
+				}
 				break;
 
 			
 			// wind control
 			case GLFW_KEY_I:
-				wind += glm::vec3(0, 0, -1);
-				cloth->blowByWind(wind);
-				std::cerr << "Wind Velocity: " << "(" <<
-					wind.x << ", " <<
-					wind.y << ", " <<
-					wind.z << ")" << std::endl;
+				if (simulation->post(Command(Command::WIND, cloth, wind + glm::vec3(0, 0, -1)))) {
+					wind += glm::vec3(0, 0, -1);
+					std::cerr << "Wind Velocity: " << "(" <<
+						wind.x << ", " <<
+						wind.y << ", " <<
+						wind.z << ")" << std::endl;
+				}
 				break;
 
 			case GLFW_KEY_K:
-				wind += glm::vec3(0, 0, 1);
-				cloth->blowByWind(wind);
-				std::cerr << "Wind Velocity: " << "(" <<
-					wind.x << ", " <<
-					wind.y << ", " <<
-					wind.z << ")" << std::endl;
+				if (simulation->post(Command(Command::WIND, cloth, wind + glm::vec3(0, 0, 1)))) {
+					wind += glm::vec3(0, 0, 1);
+					std::cerr << "Wind Velocity: " << "(" <<
+						wind.x << ", " <<
+						wind.y << ", " <<
+						wind.z << ")" << std::endl;
+				}
 				break;
 
 			case GLFW_KEY_J:
-				wind += glm::vec3(-1, 0, 0);
-				cloth->blowByWind(wind);
-				std::cerr << "Wind Velocity: " << "(" <<
-					wind.x << ", " <<
-					wind.y << ", " <<
-					wind.z << ")" << std::endl;
+				if (simulation->post(Command(Command::WIND, cloth, wind + glm::vec3(-1, 0, 0)))) {
+					wind += glm::vec3(-1, 0, 0);
+					std::cerr << "Wind Velocity: " << "(" <<
+						wind.x << ", " <<
+						wind.y << ", " <<
+						wind.z << ")" << std::endl;
+				}
 				break;
 
 			case GLFW_KEY_L:
-				wind += glm::vec3(1, 0, 0);
-				cloth->blowByWind(wind);
-				std::cerr << "Wind Velocity: " << "(" <<
-					wind.x << ", " <<
-					wind.y << ", " <<
-					wind.z << ")" << std::endl;
+				if (simulation->post(Command(Command::WIND, cloth, wind + glm::vec3(1, 0, 0)))) {
+					wind += glm::vec3(1, 0, 0);
+					std::cerr << "Wind Velocity: " << "(" <<
+						wind.x << ", " <<
+						wind.y << ", " <<
+						wind.z << ")" << std::endl;
+				}
 				break;
 
 			default:
@@ -363,6 +421,9 @@ int main(void) {
 		updateFrame(window);
 	}
 
+	// Stop stepping before the GL objects go away.
+	simulation->stop();
+
 	// Destroy the window.
 	glfwDestroyWindow(window);
 	// Terminate GLFW.
@@ -0,0 +1,33 @@
+#ifndef _HEADLESS_H_
+#define _HEADLESS_H_
+
+#include "utils.h"
+#include <cstdio>
+
+// The cloth makes its buffers as it is built; without a context every
+// GL call it makes is replaced with one that does nothing
+static void stubGL() {
+    glGenVertexArrays = [](GLsizei n, GLuint* a) {for (int i = 0; i < n; i++) a[i] = 1;};
+    glGenBuffers = [](GLsizei n, GLuint* a) {for (int i = 0; i < n; i++) a[i] = 1;};
+    glBindVertexArray = [](GLuint) {};
+    glBindBuffer = [](GLenum, GLuint) {};
+    glBufferData = [](GLenum, GLsizeiptr, const void*, GLenum) {};
+    glBufferSubData = [](GLenum, GLintptr, GLsizeiptr, const void*) {};
+    glEnableVertexAttribArray = [](GLuint) {};
+    glVertexAttribPointer = [](GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {};
+    glUseProgram = [](GLuint) {};
+    glUniformMatrix4fv = [](GLint, GLsizei, GLboolean, const GLfloat*) {};
+    glUniform3fv = [](GLint, GLsizei, const GLfloat*) {};
+    glGetUniformLocation = [](GLuint, const GLchar*) -> GLint {return 0;};
+    glDrawElements = [](GLenum, GLsizei, GLenum, const void*) {};
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    }
+
+#endif
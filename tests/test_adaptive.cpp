@@ -0,0 +1,27 @@
+#include "Headless.h"
+#include "Cloth.h"
+#include <cmath>
+
+// A substep whose forces come out NaN must be rolled back, and the next
+// steps shortened, instead of being taken as the smoothest step yet
+int main() {
+    stubGL();
+    Cloth<double> cloth(20, 20, glm::vec3(0));
+    cloth.setAdaptive(true);
+
+    const double frame = 1.0 / 60.0;
+    for (int f = 0; f < 30; f++) {
+        int substeps = cloth.planFrame(frame, 1);
+        for (int s = 0; s < substeps; s++) cloth.step();
+    }
+    unsigned long long rejections = cloth.getRejections();
+    int calm = cloth.planFrame(frame, 1);
+
+    cloth.blowByWind(glm::vec3(NAN));
+    cloth.step();
+    CHECK(cloth.getRejections() > rejections);
+    CHECK(cloth.planFrame(frame, 1) > calm);
+
+    if (failures == 0) std::printf("test_adaptive passed\n");
+    return failures == 0 ? 0 : 1;
+}
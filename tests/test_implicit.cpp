@@ -0,0 +1,39 @@
+#include "Headless.h"
+#include "Cloth.h"
+#include <cmath>
+
+// How far, on average, the row under the pins has moved along x after half
+// a second of the top row being carried along x at 2 m/s
+static double follow(bool implicit) {
+    const int n = 20;
+    Cloth<double> cloth(n, n, glm::vec3(0));
+    if (implicit) cloth.setIntegrator(Cloth<double>::IMPLICIT, 0.01);
+    typedef glm::mat<4, 4, double, glm::defaultp> mat4;
+    int track = cloth.addTrack();
+    cloth.getTrack(track).addKey(0, mat4(1));
+    cloth.getTrack(track).addKey(1, glm::translate(mat4(1), glm::vec<3, double, glm::defaultp>(2, 0, 0)));
+    for (int j = 0; j < n; j++) cloth.pin(j, track);
+
+    std::vector<glm::vec3> start;
+    for (int j = 0; j < n; j++) start.push_back(cloth.getPosition(n + j));
+    for (int f = 0; f < 30; f++) {
+        int substeps = cloth.planFrame(1.0 / 60.0, 16);
+        for (int s = 0; s < substeps; s++) cloth.step();
+    }
+    double moved = 0;
+    for (int j = 0; j < n; j++) moved += cloth.getPosition(n + j).x - start[j].x;
+    return moved / n;
+}
+
+// The neighbours of pins moving along a track must keep up with them in an
+// implicit step as they do in small explicit ones
+int main() {
+    stubGL();
+    double explicitMoved = follow(false);
+    double implicitMoved = follow(true);
+    CHECK(std::abs(explicitMoved - 1) < 0.01);
+    CHECK(std::abs(implicitMoved - explicitMoved) < 0.005);
+
+    if (failures == 0) std::printf("test_implicit passed\n");
+    return failures == 0 ? 0 : 1;
+}
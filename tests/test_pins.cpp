@@ -0,0 +1,27 @@
+#include "Headless.h"
+#include "Cloth.h"
+
+// Tears renumber the vertices; a pin must stay on the vertex it was put on
+int main() {
+    stubGL();
+    Cloth<double> cloth(30, 30, glm::vec3(0));
+    cloth.setTearing(0.1);
+    const int id = 820;
+    glm::vec3 target = cloth.getPosition(id) + glm::vec3(0, 0, 0.5);
+    cloth.pinTo(id, target);
+    cloth.blowByWind(glm::vec3(0, 0, -50));
+
+    for (int s = 0; s < 2000 && cloth.getRenumberings() < 3; s++) {
+        cloth.planFrame(0.001, 1);
+        cloth.step();
+    }
+    CHECK(cloth.getRenumberings() >= 3);
+    CHECK(cloth.isPinned(id));
+    CHECK(glm::length(cloth.getPosition(id) - target) < 1e-5f);
+
+    cloth.unpin(id);
+    CHECK(!cloth.isPinned(id));
+
+    if (failures == 0) std::printf("test_pins passed\n");
+    return failures == 0 ? 0 : 1;
+}
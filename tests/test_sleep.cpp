@@ -0,0 +1,40 @@
+#include "Headless.h"
+#include "Cloth.h"
+
+// Steps a cloth in 1 ms substeps until it is all asleep or the time is up,
+// and returns the seconds it took
+static double settle(Cloth<double>& cloth, double limit) {
+    int s = 0;
+    for (; s < limit * 1000 && !cloth.isAsleep(); s++) {
+        cloth.planFrame(0.001, 1);
+        cloth.step();
+    }
+    return s / 1000.0;
+}
+
+// A cloth left hanging from its top row must settle and sleep, and wake
+// and swing again when it is moved
+int main() {
+    stubGL();
+    Cloth<double> cloth(30, 30, glm::vec3(0));
+    cloth.setSleeping(1e-5);
+    CHECK(settle(cloth, 20) < 20);
+    CHECK(cloth.isAsleep());
+
+    const int corner = 29 * 30;
+    glm::vec3 rest = cloth.getPosition(corner);
+    cloth.translate(glm::vec3(0.5, 0, 0));
+    CHECK(!cloth.isAsleep());
+    for (int s = 0; s < 500; s++) {
+        cloth.planFrame(0.001, 1);
+        cloth.step();
+    }
+    CHECK(!cloth.isAsleep());
+    CHECK(cloth.getPosition(corner).x > rest.x + 0.1f);
+
+    CHECK(settle(cloth, 20) < 20);
+    CHECK(cloth.isAsleep());
+
+    if (failures == 0) std::printf("test_sleep passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "Headless.h"
+#include "Cloth.h"
+
+#include <cstring>
+
+// What the GL thread would hold in the index buffer
+static std::vector<unsigned int> buffer;
+static size_t sent = 0;
+
+// Tears remove springs and split vertices; the indices must stay a mesh of
+// the vertices there are, renumbering must not move them apart, and the
+// ranges sent must keep the index buffer equal to the indices
+int main() {
+    stubGL();
+    glBufferData = [](GLenum target, GLsizeiptr size, const void* data, GLenum) {
+        if (target != GL_ELEMENT_ARRAY_BUFFER) return;
+        buffer.resize(size / sizeof(unsigned int));
+        std::memcpy(buffer.data(), data, size);
+    };
+    glBufferSubData = [](GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+        if (target != GL_ELEMENT_ARRAY_BUFFER) return;
+        std::memcpy(reinterpret_cast<char*>(buffer.data()) + offset, data, size);
+        sent += size / sizeof(unsigned int);
+    };
+
+    Cloth<double> cloth(20, 20, glm::vec3(0));
+    const size_t vertices = cloth.getVertexCount();
+    const size_t springs = cloth.getSpringCount();
+    const size_t triangles = cloth.getTriangleCount();
+    cloth.setTearing(0.1);
+    cloth.pin(0);
+    cloth.pin(19);
+    cloth.blowByWind(glm::vec3(0, 0, -50));
+
+    // frames are taken and uploaded every few steps, skipping versions
+    ClothFrame frame;
+    cloth.snapshot(frame);
+    cloth.upload(frame);
+    sent = 0;
+    int uploads = 0;
+    for (int s = 0; s < 3000 && cloth.getRenumberings() < 2; s++) {
+        cloth.planFrame(0.001, 1);
+        cloth.step();
+        if (s % 7 == 0) {
+            unsigned long long topology = frame.topology;
+            cloth.snapshot(frame);
+            cloth.upload(frame);
+            if (frame.topology != topology) uploads++;
+        }
+    }
+    cloth.snapshot(frame);
+    cloth.upload(frame);
+    CHECK(cloth.getRenumberings() >= 2);
+
+    CHECK(cloth.getSpringCount() < springs);
+    CHECK(cloth.getVertexCount() > vertices);
+    CHECK(cloth.getTriangleCount() <= triangles);
+
+    // a frame filled at once holds the same indices as the one filled bit
+    // by bit, and as the buffer; edits sent less than all of them each time
+    ClothFrame fresh;
+    cloth.snapshot(fresh);
+    CHECK(fresh.indices.size() == 3 * cloth.getTriangleCount());
+    CHECK(fresh.positions.size() == cloth.getVertexCount());
+    CHECK(frame.indices == fresh.indices);
+    CHECK(buffer.size() >= fresh.indices.size());
+    CHECK(std::equal(fresh.indices.begin(), fresh.indices.end(), buffer.begin()));
+    CHECK(uploads > 0);
+    CHECK(sent < uploads * fresh.indices.size());
+
+    // every triangle has three vertices of its own, close together
+    bool mesh = true;
+    bool intact = true;
+    for (size_t t = 0; t < fresh.indices.size(); t += 3) {
+        const unsigned int* c = &fresh.indices[t];
+        for (int a = 0; a < 3; a++) {
+            if (c[a] >= fresh.positions.size() || c[a] == c[(a + 1) % 3]) mesh = false;
+        }
+        if (!mesh) break;
+        for (int a = 0; a < 3; a++) {
+            if (glm::length(fresh.positions[c[a]] - fresh.positions[c[(a + 1) % 3]]) > 0.5f) intact = false;
+        }
+    }
+    CHECK(mesh);
+    CHECK(intact);
+
+    if (failures == 0) std::printf("test_tearing passed\n");
+    return failures == 0 ? 0 : 1;
+}